@@ -0,0 +1,191 @@
+#include "cache.h"
+
+struct entry {
+	uint64_t key; /* ast_fingerprint() of tree. */
+	AST tree; /* Private copy, to rule out fingerprint collisions. */
+	Value value;
+	size_t bytes;
+	struct entry* chain; /* Next in bucket. */
+	struct entry* newer; /* LRU list. */
+	struct entry* older;
+	size_t nnames;
+	uint64_t versions[]; /* ast_versions() of tree when it was evaluated. */
+};
+
+struct Cache {
+	size_t budget;
+	size_t used;
+	size_t count;
+	size_t nbuckets; /* Power of two. */
+	struct entry** buckets;
+	struct entry* newest;
+	struct entry* oldest;
+};
+
+struct Cache* cache_make(size_t budget)
+{
+	struct Cache* c = mem_alloc(sizeof *c);
+	assert(c); /* TODO: Error handling */
+	memset(c, 0, sizeof *c);
+	c->budget = budget;
+	c->nbuckets = 64;
+	c->buckets = mem_alloc(c->nbuckets * sizeof *c->buckets);
+	assert(c->buckets); /* TODO: Error handling */
+	memset(c->buckets, 0, c->nbuckets * sizeof *c->buckets);
+	return c;
+}
+
+static void lru_unlink(struct Cache* c, struct entry* e)
+{
+	if (e->newer) {
+		e->newer->older = e->older;
+	} else {
+		c->newest = e->older;
+	}
+	if (e->older) {
+		e->older->newer = e->newer;
+	} else {
+		c->oldest = e->newer;
+	}
+}
+
+static void lru_push(struct Cache* c, struct entry* e)
+{
+	e->newer = NULL;
+	e->older = c->newest;
+	if (c->newest) {
+		c->newest->newer = e;
+	} else {
+		c->oldest = e;
+	}
+	c->newest = e;
+}
+
+static void evict(struct Cache* c, struct entry* e)
+{
+	struct entry** p = &c->buckets[e->key & (c->nbuckets - 1)];
+	while (*p != e) {
+		p = &(*p)->chain;
+	}
+	*p = e->chain;
+	lru_unlink(c, e);
+	c->used -= e->bytes;
+	c->count--;
+	ast_free(e->tree);
+	value_free(e->value);
+	mem_dealloc(e);
+}
+
+void cache_clear(struct Cache* c)
+{
+	while (c->oldest) {
+		evict(c, c->oldest);
+	}
+}
+
+void cache_free(struct Cache* c)
+{
+	if (!c) {
+		return;
+	}
+	cache_clear(c);
+	mem_dealloc(c->buckets);
+	mem_dealloc(c);
+}
+
+static void grow_buckets(struct Cache* c)
+{
+	const size_t n = c->nbuckets * 2;
+	struct entry** b = mem_alloc(n * sizeof *b);
+	assert(b); /* TODO: Error handling */
+	memset(b, 0, n * sizeof *b);
+	for (size_t i = 0; i < c->nbuckets; ++i) {
+		struct entry* e = c->buckets[i];
+		while (e) {
+			struct entry* next = e->chain;
+			e->chain = b[e->key & (n - 1)];
+			b[e->key & (n - 1)] = e;
+			e = next;
+		}
+	}
+	mem_dealloc(c->buckets);
+	c->buckets = b;
+	c->nbuckets = n;
+}
+
+/* versions are t's current ast_versions(), nnames of them. */
+static struct entry* lookup(struct Cache* c, uint64_t key, AST t,
+		const uint64_t* versions, size_t nnames)
+{
+	struct entry* e = c->buckets[key & (c->nbuckets - 1)];
+	for (; e; e = e->chain) {
+		if (e->key == key && e->nnames == nnames && ast_equal(e->tree, t)
+				&& (!nnames
+					|| !memcmp(e->versions, versions, nnames * sizeof *versions))) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void insert(struct Cache* c, uint64_t key, AST t, Value v,
+		const uint64_t* versions, size_t nnames)
+{
+	const size_t bytes = sizeof(struct entry) + nnames * sizeof *versions
+		+ ast_bytes(t) + value_bytes(v);
+	struct entry* e;
+	if (bytes > c->budget) {
+		return; /* Would evict everything and still not fit. */
+	}
+	while (c->used + bytes > c->budget) {
+		evict(c, c->oldest);
+	}
+	if (c->count >= c->nbuckets) {
+		grow_buckets(c);
+	}
+	e = mem_alloc(sizeof *e + nnames * sizeof *versions);
+	assert(e); /* TODO: Error handling */
+	e->key = key;
+	e->nnames = nnames;
+	if (nnames) {
+		memcpy(e->versions, versions, nnames * sizeof *versions);
+	}
+	e->tree = ast_copy(t);
+	e->value = value_reference(v);
+	e->bytes = bytes;
+	e->chain = c->buckets[key & (c->nbuckets - 1)];
+	c->buckets[key & (c->nbuckets - 1)] = e;
+	lru_push(c, e);
+	c->used += bytes;
+	c->count++;
+}
+
+Value cache_eval(struct Cache* c, AST t)
+{
+	uint64_t key;
+	uint64_t* versions = NULL;
+	size_t nnames;
+	struct entry* e;
+	Value v;
+	if (ast_assigns(t)) { /* Must run each time, for the binding. */
+		return Eval(t);
+	}
+	key = ast_fingerprint(t);
+	nnames = ast_versions(t, NULL);
+	if (nnames) {
+		versions = mem_alloc(nnames * sizeof *versions);
+		assert(versions); /* TODO: Error handling */
+		ast_versions(t, versions);
+	}
+	e = lookup(c, key, t, versions, nnames);
+	if (e) {
+		lru_unlink(c, e);
+		lru_push(c, e);
+		v = value_reference(e->value);
+	} else {
+		v = Eval(t);
+		insert(c, key, t, v, versions, nnames);
+	}
+	mem_dealloc(versions);
+	return v;
+}
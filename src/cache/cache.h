@@ -0,0 +1,27 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <assert.h>			/* assert() */
+#include <stdint.h>			/* uint64_t */
+#include <string.h>			/* memset() */
+#include "mem/mem.h"		/* mem_alloc(), mem_dealloc() */
+#include "value/value.h"	/* Value types */
+#include "parse/ASTNode.h"	/* AST, Eval(), ast_fingerprint() */
+
+/*
+ * Memoizes Eval() results by expression. A tree's fingerprint covers its
+ * literals and anything else it reads, so an input that changes gives a new
+ * key and the stale result simply ages out. Hits are checked against the
+ * tree and the versions of the names it read, so a fingerprint collision
+ * can't return one either. Results are shared by refcount.
+*/
+struct Cache;
+
+/* budget bounds the bytes of cached results and keys, LRU evicted. */
+struct Cache* cache_make(size_t budget);
+void cache_free(struct Cache* c);
+
+/* Eval(t), answered from the cache when t was seen before. */
+Value cache_eval(struct Cache* c, AST t);
+void cache_clear(struct Cache* c);
+#endif
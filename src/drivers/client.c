@@ -0,0 +1,91 @@
+#define _DEFAULT_SOURCE /* shutdown() */
+#include <errno.h>			/* errno */
+#include <poll.h>			/* poll() */
+#include <stdio.h>          /* fprintf() */
+#include <stdlib.h>			/* exit() */
+#include <string.h>			/* strerror() */
+#include <sys/socket.h>		/* socket(), connect(), shutdown() */
+#include <sys/un.h>			/* struct sockaddr_un */
+#include <unistd.h>			/* read(), write() */
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: client socket\n");
+	exit(EXIT_FAILURE);
+}
+
+static int connect_to(const char* path)
+{
+	struct sockaddr_un addr;
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "%s: path too long\n", path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr.sun_path, path);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof addr)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/* Copies what can be read from in to out. Returns 0 at the end of in. */
+static int copy(int in, int out)
+{
+	char buf[4096];
+	const ssize_t got = read(in, buf, sizeof buf);
+	if (got < 0) {
+		if (errno == EINTR) {
+			return 1;
+		}
+		fprintf(stderr, "error reading: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	for (ssize_t sent = 0; sent < got; ) {
+		const ssize_t k = write(out, buf + sent, (size_t)(got - sent));
+		if (k < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "error writing: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		sent += k;
+	}
+	return got > 0;
+}
+
+/*
+ * Sends stdin to the server on socket, as it's read, and copies the answers
+ * to stdout until the server has answered everything and hung up.
+*/
+int main(int argc, char** argv)
+{
+	struct pollfd fds[2];
+	if (argc != 2) {
+		usage();
+	}
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = connect_to(argv[1]);
+	fds[1].events = POLLIN;
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			return EXIT_FAILURE;
+		}
+		if (fds[0].revents && !copy(STDIN_FILENO, fds[1].fd)) {
+			shutdown(fds[1].fd, SHUT_WR); /* Nothing more to ask. */
+			fds[0].fd = -1;
+		}
+		if (fds[1].revents && !copy(fds[1].fd, STDOUT_FILENO)) {
+			return 0;
+		}
+	}
+}
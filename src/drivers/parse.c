@@ -1,18 +1,104 @@
+#define _POSIX_C_SOURCE 200809L /* getopt(), getchar_unlocked() */
+#include <errno.h>			/* errno */
 #include <stdio.h>          /* FILE*, getc() */
 #include <stdlib.h>			/* malloc(), realloc() */
+#include <unistd.h>			/* getopt() */
 #include "../parse/parse.h"	/* Parses tokens. */
-#include "../parse/ASTNode.h" /* node_free() */
+#include "../parse/ASTNode.h" /* ast_free() */
+#include "../cache/cache.h" /* cache_eval() */
+#include "../pool/pool.h"	/* pool_init() */
 
-int main(void)
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: parse [-j] [-p time|bytes|elements] [-c cache_bytes] "
+		"[-i image] [-t threads]\n");
+	exit(EXIT_FAILURE);
+}
+
+static struct Workspace* load_or_die(const char* path)
+{
+	struct Workspace* ws = ws_load(path);
+	if (!ws) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return ws;
+}
+
+/* The argument of a )command, e.g. the path in ")save path", or NULL. */
+static const char* command_arg(const char* line, const char* cmd)
+{
+	const size_t len = strlen(cmd);
+	if (strncmp(line, cmd, len) || (line[len] != ' ' && line[len] != '\t')) {
+		return NULL;
+	}
+	for (line += len; *line == ' ' || *line == '\t'; ++line) {
+	}
+	return *line ? line : NULL;
+}
+
+static int is_blank(const char* s)
+{
+	while (*s == ' ' || *s == '\t' || *s == '\r') {
+		s++;
+	}
+	return *s == '\0';
+}
+
+/*
+ * Evaluates each line of stdin as an expression, printing the results.
+ * Names persist between lines, and ")save path" and ")load path" write and
+ * read the whole workspace as an image.
+*/
+int main(int argc, char** argv)
 {
 	int c;
 	size_t bufuse = 1;
 	size_t bufsize = 1024;
 	char* buf = malloc(sizeof *buf * bufsize);
+	char* line;
 	struct Parser* p = parser_make();
-	ASTNode tree;
+	struct Cache* cache = NULL;
+	struct Workspace* ws = NULL;
+	int profile = 0;
+	enum prof_metric metric = PROF_TIME;
+	AST tree;
 	Value val;
+	while ((c = getopt(argc, argv, "c:ji:p:t:")) != -1) {
+		switch (c) {
+		case 'c':
+			cache = cache_make(strtoul(optarg, NULL, 10));
+			break;
+		case 'i':
+			ws_free(ws);
+			ws = load_or_die(optarg);
+			break;
+		case 'j':
+			ast_use_jit(1);
+			break;
+		case 'p': /* Folded stacks to stderr, for flame graphs. */
+			profile = 1;
+			if (!strcmp(optarg, "bytes")) {
+				metric = PROF_BYTES;
+			} else if (!strcmp(optarg, "elements")) {
+				metric = PROF_ELEMENTS;
+			} else if (strcmp(optarg, "time")) {
+				usage();
+			}
+			break;
+		case 't':
+			pool_init(strtoul(optarg, NULL, 10));
+			break;
+		default:
+			usage();
+		}
+	}
 	assert(buf); /* TODO: Error handling. */
+	if (!ws) {
+		ws = ws_make();
+	}
+	parser_workspace(p, ws);
 	while ((c = getchar_unlocked()) != EOF) {
 		buf[bufuse++ - 1] = (char) c;
 		if (bufuse == bufsize) {
@@ -21,13 +107,54 @@ int main(void)
 			assert(buf); /* TODO: Error handling. */
 		}
 	}
-	buf[bufuse] = '\0';
+	buf[bufuse - 1] = '\0';
 	assert(strlen(buf) == bufuse - 1);
 
-	tree = parse(p, buf, "stdin");
-	val = Eval(tree);
-	free_node(tree);
-	printf("%s\n", value_stringify(val));
-	value_free(val);
+	for (line = buf; line; ) {
+		char* end = strchr(line, '\n');
+		char* str;
+		if (end) {
+			*end = '\0';
+		}
+		if (*line == ')') { /* System commands. */
+			const char* path;
+			if ((path = command_arg(line, ")save"))) {
+				if (ws_save(ws, path)) {
+					fprintf(stderr, "%s: %s\n", path, strerror(errno));
+				}
+			} else if ((path = command_arg(line, ")load"))) {
+				struct Workspace* old = ws;
+				ws = load_or_die(path);
+				parser_workspace(p, ws);
+				if (cache) { /* Results may point into old's image. */
+					cache_clear(cache);
+				}
+				ws_free(old);
+			} else {
+				fprintf(stdout, "Error: unknown command %s\n", line);
+			}
+		} else if (!is_blank(line)) {
+			tree = parse(p, line, "stdin");
+			if (profile) {
+				struct Profile* prof = profile_make(ast_count(tree));
+				val = EvalProfiled(tree, prof);
+				ast_profile_folded(tree, prof, metric, stderr);
+				profile_free(prof);
+			} else {
+				val = cache ? cache_eval(cache, tree) : Eval(tree);
+			}
+			if (!ast_is_assignment(tree)) {
+				str = value_stringify(val);
+				printf("%s\n", str);
+				mem_dealloc(str);
+			}
+			ast_free(tree);
+			value_free(val);
+		}
+		line = end ? end + 1 : NULL;
+	}
+	cache_free(cache);
+	parser_free(p);
+	ws_free(ws);
 	free(buf);
 }
@@ -0,0 +1,692 @@
+#define _DEFAULT_SOURCE /* getopt(), sigaction(), MAP_ANONYMOUS */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open(), fcntl() */
+#include <poll.h>			/* poll() */
+#include <signal.h>			/* sigaction(), kill() */
+#include <stdint.h>			/* SIZE_MAX */
+#include <stdatomic.h>		/* atomic_fetch_add_explicit() */
+#include <stdio.h>          /* FILE*, printf() */
+#include <stdlib.h>			/* strtoul() */
+#include <sys/mman.h>		/* mmap() */
+#include <sys/socket.h>		/* socket(), accept() */
+#include <sys/un.h>			/* struct sockaddr_un */
+#include <sys/wait.h>		/* waitpid() */
+#include <time.h>			/* clock_gettime() */
+#include <unistd.h>			/* fork(), pipe(), read(), dup2() */
+#include "../parse/parse.h"	/* Parses tokens. */
+#include "../parse/ASTNode.h" /* ast_free() */
+#include "../cache/cache.h" /* cache_eval() */
+#include "../pool/pool.h"	/* pool_init() */
+
+/*
+ * Latencies are counted in buckets of nanoseconds, eight to each power of
+ * two, so a percentile is good to an eighth of itself.
+*/
+#define SUB_BUCKETS 8
+#define LATENCY_BUCKETS (62 * SUB_BUCKETS)
+#define TERMINATOR ".\n" /* Ends every response; no result prints a lone dot. */
+
+/* Shared by the master and every worker, in one anonymous mapping. */
+struct stats {
+	struct timespec start;
+	atomic_ulong requests;
+	atomic_ulong connections;
+	atomic_ulong errors; /* Evaluators or workers lost to a failed request. */
+	atomic_ulong latency[LATENCY_BUCKETS];
+};
+
+static struct stats* stats;
+static volatile sig_atomic_t stopping;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: server [-j] [-c cache_bytes] [-i image] [-t threads] "
+		"[-w workers] socket\n");
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static size_t bucket_of(uint64_t ns)
+{
+	unsigned octave;
+	if (ns < SUB_BUCKETS) {
+		return ns;
+	}
+	octave = 63 - __builtin_clzll(ns);
+	return (octave - 2) * SUB_BUCKETS
+		+ (ns >> (octave - 3) & (SUB_BUCKETS - 1));
+}
+
+/* The largest latency that falls in bucket b. */
+static uint64_t bucket_top(size_t b)
+{
+	unsigned shift;
+	if (b < SUB_BUCKETS) {
+		return b;
+	}
+	shift = b / SUB_BUCKETS - 1;
+	return ((uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+/* Counts a request that took ns. */
+static void record(uint64_t ns)
+{
+	atomic_fetch_add_explicit(&stats->requests, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats->latency[bucket_of(ns)], 1,
+		memory_order_relaxed);
+}
+
+/* The bucket holding the latency that fraction q of requests are within. */
+static uint64_t percentile(const unsigned long* counts, unsigned long total,
+		double q)
+{
+	const unsigned long rank = (unsigned long)(q * (double)(total - 1)) + 1;
+	unsigned long seen = 0;
+	for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+		seen += counts[b];
+		if (seen >= rank) {
+			return bucket_top(b);
+		}
+	}
+	return 0;
+}
+
+/* Throughput since start, and latency percentiles, read and write to out. */
+static void print_stats(FILE* out)
+{
+	static unsigned long counts[LATENCY_BUCKETS];
+	struct timespec ts;
+	unsigned long total = 0;
+	double uptime;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uptime = (double)(ts.tv_sec - stats->start.tv_sec)
+		+ (double)(ts.tv_nsec - stats->start.tv_nsec) / 1e9;
+	for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+		counts[b] = atomic_load_explicit(&stats->latency[b],
+			memory_order_relaxed);
+		total += counts[b];
+	}
+	fprintf(out, "requests %lu connections %lu errors %lu uptime %.2fs "
+		"%.0f requests/s\n",
+		atomic_load_explicit(&stats->requests, memory_order_relaxed),
+		atomic_load_explicit(&stats->connections, memory_order_relaxed),
+		atomic_load_explicit(&stats->errors, memory_order_relaxed),
+		uptime, uptime > 0 ? (double)total / uptime : 0.0);
+	if (total) {
+		fprintf(out, "latency p50 %.1fus p90 %.1fus p99 %.1fus max %.1fus\n",
+			(double)percentile(counts, total, 0.5) / 1e3,
+			(double)percentile(counts, total, 0.9) / 1e3,
+			(double)percentile(counts, total, 0.99) / 1e3,
+			(double)percentile(counts, total, 1.0) / 1e3);
+	}
+}
+
+static int is_blank(const char* s)
+{
+	while (*s == ' ' || *s == '\t' || *s == '\r') {
+		s++;
+	}
+	return *s == '\0';
+}
+
+/* What an evaluator keeps between requests. */
+struct worker {
+	struct Parser* p;
+	struct Cache* cache;
+	struct Workspace* ws;
+};
+
+/* Answers one line on stdout, which is a pipe to the worker. */
+static void respond(struct worker* w, char* line)
+{
+	AST tree;
+	Value val;
+	if (*line == ')') { /* System commands. */
+		if (!strcmp(line, ")stats")) {
+			print_stats(stdout);
+		} else {
+			printf("Error: unknown command %s\n", line);
+		}
+	} else if (!is_blank(line)) {
+		tree = parse(w->p, line, "socket");
+		if (ast_assigns(tree)) { /* Every worker must see the same names. */
+			printf("Error: the workspace is read only.\n");
+		} else {
+			char* str;
+			val = w->cache ? cache_eval(w->cache, tree) : Eval(tree);
+			str = value_stringify(val);
+			printf("%s\n", str);
+			mem_dealloc(str);
+			value_free(val);
+		}
+		ast_free(tree);
+	}
+	fputs(TERMINATOR, stdout);
+}
+
+/*
+ * Answers each line on stdin, until it closes. A failed request exits (or
+ * crashes) the process, and the worker finishes its response.
+*/
+static void evaluate(struct worker* w)
+{
+	char* line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &cap, stdin)) > 0) {
+		if (line[len - 1] == '\n') {
+			line[len - 1] = '\0';
+		}
+		respond(w, line);
+		fflush(stdout);
+	}
+	exit(EXIT_SUCCESS);
+}
+
+/* A worker's evaluator process, and the pipes to and from it. */
+struct evaluator {
+	pid_t pid; /* 0 when there's none. */
+	int to; /* Its stdin. */
+	int from; /* Its stdout. */
+	int line_start; /* Its response so far ends a line. */
+	int dot; /* And then a lone dot. */
+};
+
+/* A connection: what's been read of its requests, and what's to be sent. */
+struct client {
+	int fd;
+	char* in;
+	size_t in_len;
+	size_t in_cap;
+	uint64_t* arrived; /* When each whole line in in was read. */
+	size_t lines;
+	size_t lines_cap;
+	char* out;
+	size_t out_len;
+	size_t out_cap;
+	int eof; /* It sent all it will send. */
+	int gone; /* It can't be written to. */
+};
+
+#define NONE SIZE_MAX /* No client, as whom the evaluator is answering. */
+
+static void append(char** buf, size_t* len, size_t* cap, const char* s,
+		size_t n)
+{
+	if (*len + n > *cap) {
+		while (*len + n > *cap) {
+			*cap = *cap ? 2 * *cap : 4096;
+		}
+		*buf = mem_realloc(*buf, *cap);
+		assert(*buf); /* TODO: Error handling */
+	}
+	memcpy(*buf + *len, s, n);
+	*len += n;
+}
+
+/*
+ * Forks the evaluator from the worker, so it starts with the worker's
+ * image, parser and cache.
+*/
+static void start_evaluator(struct worker* w, struct evaluator* e,
+		int listener, const struct client* clients, size_t n)
+{
+	int to[2], from[2];
+	if (pipe(to) || pipe(from)) {
+		perror("pipe");
+		_exit(EXIT_FAILURE);
+	}
+	e->pid = fork();
+	if (e->pid < 0) {
+		perror("fork");
+		_exit(EXIT_FAILURE);
+	}
+	if (e->pid == 0) {
+		/* Connections close when the worker closes them, not when this does. */
+		close(listener);
+		for (size_t i = 0; i < n; ++i) {
+			close(clients[i].fd);
+		}
+		dup2(to[0], STDIN_FILENO);
+		dup2(from[1], STDOUT_FILENO);
+		close(to[0]);
+		close(to[1]);
+		close(from[0]);
+		close(from[1]);
+		evaluate(w);
+	}
+	close(to[0]);
+	close(from[1]);
+	e->to = to[1];
+	e->from = from[0];
+}
+
+/* Writes all of s to fd, which blocks. */
+static void send_all(int fd, const char* s, size_t len)
+{
+	while (len) {
+		const ssize_t k = write(fd, s, len);
+		if (k < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return; /* The evaluator died, which reading from it shows. */
+		}
+		s += k;
+		len -= (size_t)k;
+	}
+}
+
+/* Sends cl's first line to the evaluator, and returns when it arrived. */
+static uint64_t dispatch(struct evaluator* e, struct client* cl)
+{
+	const char* nl = memchr(cl->in, '\n', cl->in_len);
+	const size_t len = (size_t)(nl - cl->in) + 1;
+	const uint64_t arrived = cl->arrived[0];
+	send_all(e->to, cl->in, len);
+	cl->in_len -= len;
+	memmove(cl->in, cl->in + len, cl->in_len);
+	memmove(cl->arrived, cl->arrived + 1, --cl->lines * sizeof *cl->arrived);
+	e->line_start = 1;
+	e->dot = 0;
+	return arrived;
+}
+
+/* Whether c, following what the evaluator sent before, ends a response. */
+static int ends_response(struct evaluator* e, char c)
+{
+	const int done = e->dot && c == '\n';
+	e->dot = e->line_start && c == '.';
+	e->line_start = c == '\n';
+	return done;
+}
+
+/*
+ * Ends the response the evaluator was partway through when it exited or
+ * crashed. An exit has already said why; a crash hasn't.
+*/
+static void lost(struct evaluator* e, struct client* cl)
+{
+	static const char crash[] = "Error: internal error.\n";
+	int status = 0;
+	while (waitpid(e->pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	close(e->to);
+	close(e->from);
+	e->pid = 0;
+	atomic_fetch_add_explicit(&stats->errors, 1, memory_order_relaxed);
+	if (cl->gone) {
+		return;
+	}
+	if (!e->line_start) {
+		append(&cl->out, &cl->out_len, &cl->out_cap, "\n", 1);
+	}
+	if (WIFSIGNALED(status)) {
+		append(&cl->out, &cl->out_len, &cl->out_cap, crash, sizeof crash - 1);
+	}
+	append(&cl->out, &cl->out_len, &cl->out_cap, TERMINATOR,
+		sizeof TERMINATOR - 1);
+}
+
+/*
+ * Passes what the evaluator wrote on to the client it's answering. Returns
+ * nonzero once the response is complete, or the evaluator has died.
+*/
+static int relay(struct evaluator* e, struct client* cl)
+{
+	char buf[4096];
+	const ssize_t got = read(e->from, buf, sizeof buf);
+	int done = 0;
+	if (got < 0) {
+		return 0; /* Interrupted; it's still readable. */
+	}
+	if (got == 0) {
+		lost(e, cl);
+		return 1;
+	}
+	for (ssize_t i = 0; i < got; ++i) {
+		done |= ends_response(e, buf[i]);
+	}
+	if (!cl->gone) {
+		append(&cl->out, &cl->out_len, &cl->out_cap, buf, (size_t)got);
+	}
+	return done;
+}
+
+/* Reads what cl has sent, noting when each whole line arrived. */
+static void receive(struct client* cl)
+{
+	ssize_t got;
+	uint64_t now;
+	if (cl->in_len == cl->in_cap) { /* A line longer than the buffer. */
+		cl->in_cap *= 2;
+		cl->in = mem_realloc(cl->in, cl->in_cap);
+		assert(cl->in); /* TODO: Error handling */
+	}
+	got = read(cl->fd, cl->in + cl->in_len, cl->in_cap - cl->in_len);
+	if (got <= 0) {
+		if (got == 0 || (errno != EINTR && errno != EAGAIN)) {
+			cl->eof = 1;
+		}
+		return;
+	}
+	now = now_ns();
+	for (ssize_t i = 0; i < got; ++i) {
+		if (cl->in[cl->in_len + i] != '\n') {
+			continue;
+		}
+		if (cl->lines == cl->lines_cap) {
+			cl->lines_cap = cl->lines_cap ? 2 * cl->lines_cap : 16;
+			cl->arrived = mem_realloc(cl->arrived,
+				cl->lines_cap * sizeof *cl->arrived);
+			assert(cl->arrived); /* TODO: Error handling */
+		}
+		cl->arrived[cl->lines++] = now;
+	}
+	cl->in_len += (size_t)got;
+}
+
+/* Sends what cl will take of its answers without blocking. */
+static void flush_client(struct client* cl)
+{
+	size_t sent = 0;
+	while (sent < cl->out_len) {
+		const ssize_t k = write(cl->fd, cl->out + sent, cl->out_len - sent);
+		if (k < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				cl->gone = 1; /* Left without reading. */
+				sent = cl->out_len;
+			}
+			break;
+		}
+		sent += (size_t)k;
+	}
+	cl->out_len -= sent;
+	memmove(cl->out, cl->out + sent, cl->out_len);
+}
+
+/*
+ * Takes whatever connections are waiting. Every worker polls the listener,
+ * which doesn't block, so those that lose the race just go back to polling.
+*/
+static void accept_clients(int listener, struct client** clients, size_t* n,
+		size_t* cap)
+{
+	int fd;
+	while ((fd = accept(listener, NULL, NULL)) >= 0) {
+		struct client* cl;
+		if (*n == *cap) {
+			*cap = *cap ? 2 * *cap : 16;
+			*clients = mem_realloc(*clients, sizeof **clients * *cap);
+			assert(*clients); /* TODO: Error handling */
+		}
+		/* A client that doesn't read its answers can't stall the others. */
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		cl = &(*clients)[(*n)++];
+		memset(cl, 0, sizeof *cl);
+		cl->fd = fd;
+		cl->in_cap = 4096;
+		cl->in = mem_alloc(cl->in_cap);
+		assert(cl->in); /* TODO: Error handling */
+		atomic_fetch_add_explicit(&stats->connections, 1, memory_order_relaxed);
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+			&& errno != ECONNABORTED) {
+		perror("accept");
+		_exit(EXIT_FAILURE);
+	}
+}
+
+/* Whether cl has nothing more to ask or be told, or can't be told it. */
+static int finished(const struct client* cl)
+{
+	return cl->gone || (cl->eof && !cl->lines && !cl->out_len);
+}
+
+/*
+ * Serves any number of clients at once, polling them, the listener and the
+ * evaluator, which answers a request at a time. Clients take turns, and
+ * one's next request waits until it has read the last answer, so a client
+ * that doesn't read holds up only itself. A request that fails takes down
+ * the evaluator, not the worker: the worker finishes that response and
+ * starts another evaluator for the requests after it.
+*/
+static void work(struct worker* w, int listener)
+{
+	struct pollfd* fds = NULL; /* The listener, evaluator, then clients. */
+	size_t fds_cap = 0;
+	struct client* clients = NULL;
+	size_t n = 0, cap = 0;
+	size_t turn = 0; /* Where the round of clients resumes. */
+	size_t busy = NONE; /* Whose request the evaluator has. */
+	uint64_t arrived = 0; /* When that request was read. */
+	struct evaluator e = { 0 };
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = SIG_DFL;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	for (;;) {
+		for (size_t k = 0; busy == NONE && k < n; ++k) {
+			const size_t i = (turn + k) % n;
+			if (clients[i].lines && !clients[i].gone && !clients[i].out_len) {
+				if (!e.pid) {
+					start_evaluator(w, &e, listener, clients, n);
+				}
+				arrived = dispatch(&e, &clients[i]);
+				busy = i;
+				turn = i + 1;
+			}
+		}
+		if (n + 2 > fds_cap) {
+			fds_cap = 2 * (n + 2);
+			fds = mem_realloc(fds, fds_cap * sizeof *fds);
+			assert(fds); /* TODO: Error handling */
+		}
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		fds[1].fd = busy == NONE ? -1 : e.from; /* poll() skips -1. */
+		fds[1].events = POLLIN;
+		for (size_t i = 0; i < n; ++i) {
+			const struct client* cl = &clients[i];
+			/* A full buffer is only read into once a line is taken. */
+			fds[i + 2].events = (!cl->eof && (!cl->lines
+				|| cl->in_len < cl->in_cap) ? POLLIN : 0)
+				| (cl->out_len ? POLLOUT : 0);
+			/* Else a hang up would be reported until it's served. */
+			fds[i + 2].fd = fds[i + 2].events ? cl->fd : -1;
+		}
+		if (poll(fds, n + 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			_exit(EXIT_FAILURE);
+		}
+		if (fds[1].revents && relay(&e, &clients[busy])) {
+			record(now_ns() - arrived);
+			flush_client(&clients[busy]);
+			busy = NONE;
+		}
+		for (size_t i = n; i-- > 0; ) { /* Backwards, so the last can fill i. */
+			struct client* cl = &clients[i];
+			if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) {
+				receive(cl);
+			}
+			if (fds[i + 2].revents & POLLOUT) {
+				flush_client(cl);
+			}
+			if (finished(cl) && busy != i) {
+				close(cl->fd); /* So the client sees the socket close. */
+				mem_dealloc(cl->in);
+				mem_dealloc(cl->arrived);
+				mem_dealloc(cl->out);
+				*cl = clients[--n];
+				if (busy == n) {
+					busy = i;
+				}
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			accept_clients(listener, &clients, &n, &cap);
+		}
+	}
+}
+
+static pid_t spawn(struct worker* w, int listener)
+{
+	const pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		work(w, listener);
+	}
+	return pid;
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static int listen_on(const char* path)
+{
+	struct sockaddr_un addr;
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "%s: path too long\n", path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof addr)
+			|| listen(fd, SOMAXCONN)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/*
+ * Serves expressions on a Unix socket: each line a client sends is
+ * evaluated and answered with its result, then a line holding only a dot.
+ * A fixed set of worker processes each serve many clients, through an
+ * evaluator process that answers a request at a time. A request that fails
+ * takes down only the evaluator, which is replaced; it's still answered,
+ * and the worker's other clients, and their later requests, are served as
+ * before. Evaluators share the image's pages, read only, and keep their
+ * heap, cache and JIT kernels warm from one request to the next. ")stats"
+ * reports throughput and latency, as does the server on stderr when it's
+ * stopped.
+*/
+int main(int argc, char** argv)
+{
+	int c;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workers = 4 * (size_t)(cpus > 0 ? cpus : 1);
+	size_t threads = 1; /* Workers, not the pool, keep the CPUs busy. */
+	size_t live = 0;
+	pid_t* pids;
+	int listener;
+	struct worker w = { parser_make(), NULL, NULL };
+	struct sigaction sa;
+	while ((c = getopt(argc, argv, "c:ji:t:w:")) != -1) {
+		switch (c) {
+		case 'c':
+			w.cache = cache_make(strtoul(optarg, NULL, 10));
+			break;
+		case 'i':
+			ws_free(w.ws);
+			w.ws = ws_load(optarg);
+			if (!w.ws) {
+				fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'j':
+			ast_use_jit(1);
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			workers = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 1 || workers == 0) {
+		usage();
+	}
+	pool_init(threads); /* Started in each worker, on first use. */
+	if (!w.ws) {
+		w.ws = ws_make();
+	}
+	parser_workspace(w.p, w.ws);
+	stats = mmap(NULL, sizeof *stats, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+	memset(stats, 0, sizeof *stats);
+	clock_gettime(CLOCK_MONOTONIC, &stats->start);
+	listener = listen_on(argv[optind]);
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL); /* A write to a closed client just fails. */
+	sa.sa_handler = stop; /* Without SA_RESTART, so waitpid() returns. */
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	fflush(stdout); /* Nothing buffered is written twice by the workers. */
+	pids = mem_alloc(sizeof *pids * workers);
+	assert(pids); /* TODO: Error handling */
+	for (; live < workers; ++live) {
+		pids[live] = spawn(&w, listener);
+	}
+	while (!stopping) {
+		int status;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			continue;
+		}
+		for (size_t i = 0; i < workers; ++i) {
+			if (pids[i] == pid) {
+				atomic_fetch_add_explicit(&stats->errors, 1,
+					memory_order_relaxed);
+				pids[i] = spawn(&w, listener);
+			}
+		}
+	}
+	for (size_t i = 0; i < workers; ++i) {
+		kill(pids[i], SIGTERM);
+	}
+	while (wait(NULL) > 0) {
+	}
+	print_stats(stderr);
+	unlink(argv[optind]);
+	close(listener);
+	mem_dealloc(pids);
+	cache_free(w.cache);
+	parser_free(w.p);
+	ws_free(w.ws);
+	return 0;
+}
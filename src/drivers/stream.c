@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L /* getopt() */
+#include <stdio.h>          /* FILE*, fopen() */
+#include <stdlib.h>			/* strtoul() */
+#include <errno.h>			/* errno, strerror() */
+#include <unistd.h>			/* getopt() */
+#include "../parse/parse.h"	/* Parses tokens. */
+#include "../stream/stream.h" /* stream_eval() */
+#include "../pool/pool.h"	/* pool_init() */
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: stream [-j] [-n chunk_elements] [-o out] [-t threads] "
+		"expr [alpha] omega\n");
+	exit(EXIT_FAILURE);
+}
+
+static struct Source* open_or_die(const char* path, size_t chunk)
+{
+	struct Source* s = source_open(path, chunk);
+	if (!s) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return s;
+}
+
+/*
+ * Evaluates expr over files of native longs bound to ⍺ and ⍵, a chunk at a
+ * time. Elementwise results go to out (as longs), or stdout (as text).
+*/
+int main(int argc, char** argv)
+{
+	int c;
+	size_t chunk = 1 << 20;
+	char* out_path = NULL;
+	struct Parser* p = parser_make();
+	struct Source* left = NULL, *right = NULL;
+	struct Sink sink = { sink_text, stdout, 0 };
+	AST tree;
+	Value total;
+	while ((c = getopt(argc, argv, "jn:o:t:")) != -1) {
+		switch (c) {
+		case 'j':
+			ast_use_jit(1);
+			break;
+		case 'n':
+			chunk = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 't':
+			pool_init(strtoul(optarg, NULL, 10));
+			break;
+		default:
+			usage();
+		}
+	}
+	if (chunk == 0 || argc - optind < 2 || argc - optind > 3) {
+		usage();
+	}
+	if (out_path) {
+		sink.write = sink_binary;
+		sink.out = fopen(out_path, "wb");
+		if (!sink.out) {
+			fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+	tree = parse(p, argv[optind], "argv");
+	if (argc - optind == 3) {
+		left = open_or_die(argv[optind + 1], chunk);
+	}
+	right = open_or_die(argv[argc - 1], chunk);
+
+	total = stream_eval(tree, left, right, &sink);
+	if (total) {
+		char* str = value_stringify(total);
+		printf("%s\n", str);
+		mem_dealloc(str);
+		value_free(total);
+	} else if (!out_path) {
+		printf("\n");
+	}
+	source_close(left);
+	source_close(right);
+	ast_free(tree);
+	parser_free(p);
+	if (fclose(sink.out)) {
+		fprintf(stderr, "error out: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
@@ -0,0 +1,341 @@
+#include <stdint.h>		/* uint64_t */
+#include "hash.h"
+
+#define WORD_BITS (CHAR_BIT * sizeof(unsigned long))
+#define PARALLEL_MIN (1 << 16) /* Smaller inputs are built on one thread. */
+#define MAX_PARTS 64
+#define DENSE_MIN 4096 /* Ranges this small are always looked up directly. */
+#define PROBE_CHUNK (1 << 14) /* Keys per probing task; whole words of bits. */
+
+struct slot {
+	unsigned long key;
+	size_t pos; /* First position + 1, or 0 if empty. */
+};
+
+struct table {
+	struct slot* slots;
+	size_t mask; /* Slots - 1, a power of two less one. */
+};
+
+struct Hash {
+	size_t n;
+	/* Direct: keys in [lo, lo + span), at their offset from lo. */
+	unsigned long lo;
+	size_t span; /* 0 if hashed. */
+	size_t* first; /* First position + 1, or 0; NULL if not kept. */
+	unsigned long* seen; /* A bit per key, when positions aren't kept. */
+	/* Hashed: a table per part, chosen by the top bits of the hash. */
+	struct table* tables;
+	size_t parts; /* A power of two. */
+	unsigned part_bits;
+};
+
+/* Spreads every bit of key over the hash (MurmurHash3's finalizer). */
+static uint64_t mix(unsigned long key)
+{
+	uint64_t h = key;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static size_t part_of(const struct Hash* h, uint64_t hash)
+{
+	return h->part_bits ? (size_t)(hash >> (64 - h->part_bits)) : 0;
+}
+
+static void table_make(struct table* t, size_t count)
+{
+	size_t cap = 2;
+	while (cap < 2 * count) {
+		cap *= 2;
+	}
+	t->slots = mem_alloc(sizeof *t->slots * cap);
+	assert(t->slots); /* TODO: Error handling */
+	memset(t->slots, 0, sizeof *t->slots * cap);
+	t->mask = cap - 1;
+}
+
+/* Adds key at pos, unless it's already there from an earlier position. */
+static void insert(struct table* t, unsigned long key, uint64_t hash,
+		size_t pos)
+{
+	for (size_t i = (size_t)hash & t->mask; ; i = (i + 1) & t->mask) {
+		struct slot* s = &t->slots[i];
+		if (!s->pos) {
+			s->key = key;
+			s->pos = pos + 1;
+			return;
+		}
+		if (s->key == key) {
+			return;
+		}
+	}
+}
+
+/* The first position + 1 of key, or 0 if it isn't indexed. */
+static size_t lookup(const struct Hash* h, unsigned long key)
+{
+	if (h->span) {
+		const unsigned long off = key - h->lo;
+		if (off >= h->span) {
+			return 0;
+		}
+		if (h->first) {
+			return h->first[off];
+		}
+		return h->seen[off / WORD_BITS] >> (off % WORD_BITS) & 1;
+	} else {
+		const uint64_t hash = mix(key);
+		const struct table* t = &h->tables[part_of(h, hash)];
+		for (size_t i = (size_t)hash & t->mask; ; i = (i + 1) & t->mask) {
+			const struct slot* s = &t->slots[i];
+			if (!s->pos || s->key == key) {
+				return s->pos;
+			}
+		}
+	}
+}
+
+/* A parallel build: keys split into chunks, each partitioned by hash. */
+struct build {
+	struct Hash* h;
+	const unsigned long* keys;
+	size_t chunks;
+	size_t (*counts)[MAX_PARTS]; /* Each chunk's keys per part, then slots. */
+	size_t* starts; /* Where each part's keys begin in entries. */
+	struct slot* entries; /* Keys grouped by part, in order within each. */
+};
+
+static size_t chunk_start(const struct build* b, size_t c)
+{
+	const size_t n = b->h->n;
+	return n / b->chunks * c + (c < n % b->chunks ? c : n % b->chunks);
+}
+
+static void count_chunk(void* arg, size_t c)
+{
+	struct build* b = arg;
+	size_t* counts = b->counts[c];
+	const size_t end = chunk_start(b, c + 1);
+	memset(counts, 0, sizeof b->counts[c]);
+	for (size_t i = chunk_start(b, c); i < end; ++i) {
+		counts[part_of(b->h, mix(b->keys[i]))]++;
+	}
+}
+
+static void scatter_chunk(void* arg, size_t c)
+{
+	struct build* b = arg;
+	size_t* at = b->counts[c];
+	const size_t end = chunk_start(b, c + 1);
+	for (size_t i = chunk_start(b, c); i < end; ++i) {
+		struct slot* e = &b->entries[at[part_of(b->h, mix(b->keys[i]))]++];
+		e->key = b->keys[i];
+		e->pos = i;
+	}
+}
+
+static void build_part(void* arg, size_t p)
+{
+	struct build* b = arg;
+	struct table* t = &b->h->tables[p];
+	table_make(t, b->starts[p + 1] - b->starts[p]);
+	for (size_t i = b->starts[p]; i < b->starts[p + 1]; ++i) {
+		insert(t, b->entries[i].key, mix(b->entries[i].key), b->entries[i].pos);
+	}
+}
+
+static void build_parallel(struct Hash* h, const unsigned long* keys)
+{
+	struct build b;
+	size_t at = 0;
+	b.h = h;
+	b.keys = keys;
+	b.chunks = pool_threads() < MAX_PARTS ? pool_threads() : MAX_PARTS;
+	b.counts = mem_alloc(sizeof *b.counts * b.chunks);
+	b.starts = mem_alloc(sizeof *b.starts * (h->parts + 1));
+	b.entries = mem_alloc(sizeof *b.entries * h->n);
+	assert(b.counts && b.starts && b.entries); /* TODO: Error handling */
+	pool_run(b.chunks, count_chunk, &b);
+	for (size_t p = 0; p < h->parts; ++p) { /* Counts become slots. */
+		b.starts[p] = at;
+		for (size_t c = 0; c < b.chunks; ++c) {
+			const size_t count = b.counts[c][p];
+			b.counts[c][p] = at;
+			at += count;
+		}
+	}
+	b.starts[h->parts] = at;
+	pool_run(b.chunks, scatter_chunk, &b);
+	pool_run(h->parts, build_part, &b);
+	mem_dealloc(b.entries);
+	mem_dealloc(b.starts);
+	mem_dealloc(b.counts);
+}
+
+static void build_dense(struct Hash* h, const unsigned long* keys,
+		int positions)
+{
+	if (positions) {
+		h->first = mem_alloc(sizeof *h->first * h->span);
+		assert(h->first); /* TODO: Error handling */
+		memset(h->first, 0, sizeof *h->first * h->span);
+		for (size_t i = h->n; i-- > 0; ) { /* Backwards, so first wins. */
+			h->first[keys[i] - h->lo] = i + 1;
+		}
+	} else {
+		const size_t words = (h->span + WORD_BITS - 1) / WORD_BITS;
+		h->seen = mem_alloc(sizeof *h->seen * words);
+		assert(h->seen); /* TODO: Error handling */
+		memset(h->seen, 0, sizeof *h->seen * words);
+		for (size_t i = 0; i < h->n; ++i) {
+			const unsigned long off = keys[i] - h->lo;
+			h->seen[off / WORD_BITS] |= 1UL << (off % WORD_BITS);
+		}
+	}
+}
+
+struct Hash* hash_make(const unsigned long* keys, size_t n, int positions)
+{
+	struct Hash* h = mem_alloc(sizeof *h);
+	unsigned long lo = ~0UL, hi = 0;
+	/* A position table costs a word per key in range, and a hash table
+	 * four per key indexed; a bitmap is cheaper still. */
+	const size_t dense = DENSE_MIN + (positions ? 2 * n : WORD_BITS * n);
+	assert(h); /* TODO: Error handling */
+	memset(h, 0, sizeof *h);
+	h->n = n;
+	for (size_t i = 0; i < n; ++i) {
+		lo = keys[i] < lo ? keys[i] : lo;
+		hi = keys[i] > hi ? keys[i] : hi;
+	}
+	if (n && hi - lo < dense) {
+		h->lo = lo;
+		h->span = hi - lo + 1;
+		build_dense(h, keys, positions);
+		return h;
+	}
+	h->parts = 1;
+	if (n >= PARALLEL_MIN && pool_threads() > 1) {
+		while (h->parts < 2 * pool_threads() && h->parts < MAX_PARTS) {
+			h->parts *= 2;
+			h->part_bits++;
+		}
+	}
+	h->tables = mem_alloc(sizeof *h->tables * h->parts);
+	assert(h->tables); /* TODO: Error handling */
+	if (h->parts > 1) {
+		build_parallel(h, keys);
+	} else {
+		table_make(&h->tables[0], n);
+		for (size_t i = 0; i < n; ++i) {
+			insert(&h->tables[0], keys[i], mix(keys[i]), i);
+		}
+	}
+	return h;
+}
+
+void hash_free(struct Hash* h)
+{
+	if (!h) {
+		return;
+	}
+	for (size_t p = 0; h->tables && p < h->parts; ++p) {
+		mem_dealloc(h->tables[p].slots);
+	}
+	mem_dealloc(h->tables);
+	mem_dealloc(h->first);
+	mem_dealloc(h->seen);
+	mem_dealloc(h);
+}
+
+/* Searches for m keys, a chunk of them per task. */
+struct probe {
+	const struct Hash* h;
+	const unsigned long* keys;
+	size_t m;
+	unsigned long* out;
+};
+
+static void find_chunk(void* arg, size_t c)
+{
+	struct probe* pr = arg;
+	const size_t end = pr->m - c * PROBE_CHUNK < PROBE_CHUNK
+		? pr->m : (c + 1) * PROBE_CHUNK;
+	for (size_t i = c * PROBE_CHUNK; i < end; ++i) {
+		const size_t pos = lookup(pr->h, pr->keys[i]);
+		pr->out[i] = pos ? pos - 1 : pr->h->n;
+	}
+}
+
+static void member_chunk(void* arg, size_t c)
+{
+	struct probe* pr = arg;
+	const size_t end = pr->m - c * PROBE_CHUNK < PROBE_CHUNK
+		? pr->m : (c + 1) * PROBE_CHUNK;
+	for (size_t i = c * PROBE_CHUNK; i < end; ++i) {
+		if (lookup(pr->h, pr->keys[i])) {
+			pr->out[i / WORD_BITS] |= 1UL << (i % WORD_BITS);
+		}
+	}
+}
+
+void hash_find(const struct Hash* h, const unsigned long* keys, size_t m,
+		unsigned long* pos)
+{
+	struct probe pr = { h, keys, m, pos };
+	assert(h->first || h->tables);
+	pool_run((m + PROBE_CHUNK - 1) / PROBE_CHUNK, find_chunk, &pr);
+}
+
+void hash_member(const struct Hash* h, const unsigned long* keys, size_t m,
+		unsigned long* bits)
+{
+	struct probe pr = { h, keys, m, bits };
+	pool_run((m + PROBE_CHUNK - 1) / PROBE_CHUNK, member_chunk, &pr);
+}
+
+struct marks {
+	const struct Hash* h;
+	unsigned char* first; /* Whether each position is a key's first. */
+};
+
+static void mark_part(void* arg, size_t p)
+{
+	struct marks* mk = arg;
+	const struct table* t = &mk->h->tables[p];
+	for (size_t i = 0; i <= t->mask; ++i) {
+		if (t->slots[i].pos) {
+			mk->first[t->slots[i].pos - 1] = 1;
+		}
+	}
+}
+
+size_t hash_firsts(const struct Hash* h, size_t* firsts)
+{
+	struct marks mk = { h, mem_alloc(h->n ? h->n : 1) };
+	size_t count = 0;
+	assert(mk.first); /* TODO: Error handling */
+	assert(h->first || h->tables);
+	memset(mk.first, 0, h->n);
+	if (h->span) {
+		for (size_t off = 0; off < h->span; ++off) {
+			if (h->first[off]) {
+				mk.first[h->first[off] - 1] = 1;
+			}
+		}
+	} else {
+		pool_run(h->parts, mark_part, &mk);
+	}
+	for (size_t i = 0; i < h->n; ++i) {
+		if (mk.first[i]) {
+			firsts[count++] = i;
+		}
+	}
+	mem_dealloc(mk.first);
+	return count;
+}
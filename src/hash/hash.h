@@ -0,0 +1,34 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <assert.h>		/* assert() */
+#include <limits.h>		/* CHAR_BIT */
+#include <stddef.h>		/* size_t */
+#include <string.h>		/* memset() */
+#include "mem/mem.h"	/* mem_alloc(), mem_dealloc() */
+#include "pool/pool.h"	/* pool_run() */
+
+/*
+ * An index of n unsigned keys, for searching: which keys it holds and, if
+ * asked for, where each first occurs. Keys spanning a small range (for
+ * their count) are looked up directly, in a table of first positions or a
+ * bitmap. Others go in open addressing hash tables, kept under half full.
+ * Large inputs are partitioned by hash across the thread pool, a table per
+ * partition, built and probed in parallel.
+*/
+struct Hash;
+
+/* Indexes keys, which the caller keeps. Positions are needed by hash_find()
+ * and hash_firsts(); without them dense keys take a bit each. */
+struct Hash* hash_make(const unsigned long* keys, size_t n, int positions);
+void hash_free(struct Hash* h);
+
+/* For each of m keys, the position of its first occurrence, or n if none. */
+void hash_find(const struct Hash* h, const unsigned long* keys, size_t m,
+	unsigned long* pos);
+/* Sets bit i of the packed bits (zeroed) for each key i that's indexed. */
+void hash_member(const struct Hash* h, const unsigned long* keys, size_t m,
+	unsigned long* bits);
+/* The first position of each distinct key, in order. Returns their count. */
+size_t hash_firsts(const struct Hash* h, size_t* firsts);
+#endif
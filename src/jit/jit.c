@@ -0,0 +1,469 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#include <string.h>		/* memcpy(), memcmp() */
+#include "jit.h"
+
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+#include <pthread.h>	/* pthread_mutex_lock() */
+#include <sys/mman.h>	/* mmap(), mprotect() */
+
+/*
+ * Kernels evaluate the program a vector register of elements at a time.
+ * Registers are allocated Sethi-Ullman style, so a tree needing more than
+ * STACK_REGS live values is refused. The last two registers are reserved: T
+ * holds a result while its overflow is checked (or a comparison's mask), and
+ * ACC collects overflow.
+ *
+ * Kernel registers (SysV): rdi out, rsi vecs, rdx scalars, rcx n,
+ * rax element index, r8 the vector being loaded.
+*/
+enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R8 = 8 };
+enum { STACK_REGS = 14, T = 14, ACC = 15 };
+
+struct code {
+	unsigned char* p;
+	size_t len;
+	size_t cap;
+};
+
+static void byte(struct code* c, unsigned b)
+{
+	if (c->len == c->cap) {
+		c->cap = c->cap ? c->cap * 2 : 256;
+		c->p = mem_realloc(c->p, c->cap);
+		assert(c->p); /* TODO: Error handling */
+	}
+	c->p[c->len++] = (unsigned char)b;
+}
+
+static void u32(struct code* c, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i) {
+		byte(c, (v >> (8 * i)) & 0xFF);
+	}
+}
+
+/* A ModRM operand: a register, [base + index*8] or [base + disp32]. */
+struct rm {
+	int is_mem;
+	int reg;
+	int base;
+	int index; /* -1 for none. */
+	int32_t disp;
+};
+
+static struct rm reg(int r)
+{
+	const struct rm rm = { 0, r, 0, -1, 0 };
+	return rm;
+}
+
+static struct rm mem_index(int base, int index)
+{
+	const struct rm rm = { 1, 0, base, index, 0 };
+	assert((base & 7) != 5); /* rbp and r13 would mean disp32 only. */
+	return rm;
+}
+
+static struct rm mem_disp(int base, int32_t disp)
+{
+	const struct rm rm = { 1, 0, base, -1, disp };
+	assert((base & 7) != 4); /* rsp and r12 would need a SIB byte. */
+	return rm;
+}
+
+static int ext_x(struct rm rm)
+{
+	return rm.is_mem && rm.index >= 8;
+}
+
+static int ext_b(struct rm rm)
+{
+	return rm.is_mem ? rm.base >= 8 : rm.reg >= 8;
+}
+
+static void modrm(struct code* c, int r, struct rm rm)
+{
+	if (!rm.is_mem) {
+		byte(c, 0xC0 | (r & 7) << 3 | (rm.reg & 7));
+	} else if (rm.index >= 0) {
+		byte(c, 0x04 | (r & 7) << 3); /* SIB follows. */
+		byte(c, 0xC0 | (rm.index & 7) << 3 | (rm.base & 7)); /* Scale 8. */
+	} else {
+		byte(c, 0x80 | (r & 7) << 3 | (rm.base & 7));
+		u32(c, (uint32_t)rm.disp);
+	}
+}
+
+/* Legacy SSE: prefix [REX] 0F op /r. */
+static void sse(struct code* c, unsigned prefix, unsigned op, int r,
+		struct rm rm)
+{
+	const unsigned rex = 0x40 | (r >= 8) << 2 | ext_x(rm) << 1 | ext_b(rm);
+	byte(c, prefix);
+	if (rex != 0x40) {
+		byte(c, rex);
+	}
+	byte(c, 0x0F);
+	byte(c, op);
+	modrm(c, r, rm);
+}
+
+enum { PP_66 = 1, PP_F3 = 2 };
+enum { MAP_0F = 1, MAP_0F38 = 2, MAP_0F3A = 3 };
+
+/* Three byte VEX, 256 bit. v is the extra source register, 0 if unused. */
+static void vex(struct code* c, unsigned pp, unsigned map, unsigned op,
+		int r, int v, struct rm rm)
+{
+	byte(c, 0xC4);
+	byte(c, (r < 8) << 7 | !ext_x(rm) << 6 | !ext_b(rm) << 5 | map);
+	byte(c, (~v & 15) << 3 | 1 << 2 | pp);
+	byte(c, op);
+	modrm(c, r, rm);
+}
+
+static void jump_rel32(struct code* c, unsigned cc, size_t target)
+{
+	byte(c, 0x0F);
+	byte(c, 0x80 | cc);
+	u32(c, (uint32_t)(target - (c->len + 4)));
+}
+
+/*
+ * A dyad, d = l f r, checked for overflow. d is l or r, and both may be
+ * overwritten.
+*/
+typedef void (*emit_dyad)(struct code* c, int d, int l, int r);
+
+/* Register allocation and emission for one instruction set. */
+struct isa {
+	size_t lanes;
+	void (*load)(struct code* c, int r, struct rm src);
+	void (*broadcast)(struct code* c, int r, struct rm src);
+	void (*store)(struct code* c, struct rm dst, int r);
+	emit_dyad dyads[JIT_OPS - JIT_ADD]; /* NULL where there's no instruction. */
+	void (*zero_acc)(struct code* c);
+	void (*epilogue)(struct code* c); /* eax = overflow lanes. */
+};
+
+static void sse_load(struct code* c, int r, struct rm src)
+{
+	sse(c, 0xF3, 0x6F, r, src); /* movdqu */
+}
+
+static void sse_broadcast(struct code* c, int r, struct rm src)
+{
+	sse(c, 0xF3, 0x7E, r, src); /* movq */
+	sse(c, 0x66, 0x6C, r, reg(r)); /* punpcklqdq */
+}
+
+static void sse_store(struct code* c, struct rm dst, int r)
+{
+	sse(c, 0xF3, 0x7F, r, dst); /* movdqu */
+}
+
+/* Overflowed iff both operands differ in sign from the sum. */
+static void sse_add(struct code* c, int d, int l, int r)
+{
+	sse(c, 0x66, 0x6F, T, reg(l)); /* movdqa t, l */
+	sse(c, 0x66, 0xD4, T, reg(r)); /* paddq t, r */
+	sse(c, 0x66, 0xEF, l, reg(T)); /* pxor l, t */
+	sse(c, 0x66, 0xEF, r, reg(T)); /* pxor r, t */
+	sse(c, 0x66, 0xDB, l, reg(r)); /* pand l, r */
+	sse(c, 0x66, 0xEB, ACC, reg(l)); /* por acc, l */
+	sse(c, 0x66, 0x6F, d, reg(T)); /* movdqa d, t */
+}
+
+/* Overflowed iff l differs in sign from both r and the difference. */
+static void sse_sub(struct code* c, int d, int l, int r)
+{
+	sse(c, 0x66, 0x6F, T, reg(l)); /* movdqa t, l */
+	sse(c, 0x66, 0xFB, T, reg(r)); /* psubq t, r */
+	sse(c, 0x66, 0xEF, r, reg(l)); /* pxor r, l */
+	sse(c, 0x66, 0xEF, l, reg(T)); /* pxor l, t */
+	sse(c, 0x66, 0xDB, l, reg(r)); /* pand l, r */
+	sse(c, 0x66, 0xEB, ACC, reg(l)); /* por acc, l */
+	sse(c, 0x66, 0x6F, d, reg(T)); /* movdqa d, t */
+}
+
+static void sse_zero_acc(struct code* c)
+{
+	sse(c, 0x66, 0xEF, ACC, reg(ACC)); /* pxor */
+}
+
+static void sse_epilogue(struct code* c)
+{
+	sse(c, 0x66, 0x50, RAX, reg(ACC)); /* movmskpd eax, acc */
+}
+
+static void avx_load(struct code* c, int r, struct rm src)
+{
+	vex(c, PP_F3, MAP_0F, 0x6F, r, 0, src); /* vmovdqu */
+}
+
+static void avx_broadcast(struct code* c, int r, struct rm src)
+{
+	vex(c, PP_66, MAP_0F38, 0x59, r, 0, src); /* vpbroadcastq */
+}
+
+static void avx_store(struct code* c, struct rm dst, int r)
+{
+	vex(c, PP_F3, MAP_0F, 0x7F, r, 0, dst); /* vmovdqu */
+}
+
+static void avx_add(struct code* c, int d, int l, int r)
+{
+	vex(c, PP_66, MAP_0F, 0xD4, T, l, reg(r)); /* vpaddq t, l, r */
+	vex(c, PP_66, MAP_0F, 0xEF, l, l, reg(T)); /* vpxor l, l, t */
+	vex(c, PP_66, MAP_0F, 0xEF, r, r, reg(T)); /* vpxor r, r, t */
+	vex(c, PP_66, MAP_0F, 0xDB, l, l, reg(r)); /* vpand l, l, r */
+	vex(c, PP_66, MAP_0F, 0xEB, ACC, ACC, reg(l)); /* vpor acc, acc, l */
+	vex(c, PP_66, MAP_0F, 0x6F, d, 0, reg(T)); /* vmovdqa d, t */
+}
+
+static void avx_sub(struct code* c, int d, int l, int r)
+{
+	vex(c, PP_66, MAP_0F, 0xFB, T, l, reg(r)); /* vpsubq t, l, r */
+	vex(c, PP_66, MAP_0F, 0xEF, r, r, reg(l)); /* vpxor r, r, l */
+	vex(c, PP_66, MAP_0F, 0xEF, l, l, reg(T)); /* vpxor l, l, t */
+	vex(c, PP_66, MAP_0F, 0xDB, l, l, reg(r)); /* vpand l, l, r */
+	vex(c, PP_66, MAP_0F, 0xEB, ACC, ACC, reg(l)); /* vpor acc, acc, l */
+	vex(c, PP_66, MAP_0F, 0x6F, d, 0, reg(T)); /* vmovdqa d, t */
+}
+
+/* d = mask ? on : off, a byte at a time, with the mask's lanes all set or not. */
+static void avx_blend(struct code* c, int d, int off, int on, int mask)
+{
+	vex(c, PP_66, MAP_0F3A, 0x4C, d, off, reg(on)); /* vpblendvb d, off, on, */
+	byte(c, (unsigned)mask << 4); /* mask */
+}
+
+/* Selections can't overflow. */
+static void avx_max(struct code* c, int d, int l, int r)
+{
+	vex(c, PP_66, MAP_0F38, 0x37, T, l, reg(r)); /* vpcmpgtq t, l, r */
+	avx_blend(c, d, r, l, T);
+}
+
+static void avx_min(struct code* c, int d, int l, int r)
+{
+	vex(c, PP_66, MAP_0F38, 0x37, T, l, reg(r)); /* vpcmpgtq t, l, r */
+	avx_blend(c, d, l, r, T);
+}
+
+static void avx_zero_acc(struct code* c)
+{
+	vex(c, PP_66, MAP_0F, 0xEF, ACC, ACC, reg(ACC)); /* vpxor */
+}
+
+static void avx_epilogue(struct code* c)
+{
+	vex(c, PP_66, MAP_0F, 0x50, RAX, 0, reg(ACC)); /* vmovmskpd eax, acc */
+	byte(c, 0xC5); /* vzeroupper */
+	byte(c, 0xF8);
+	byte(c, 0x77);
+}
+
+/* SSE2 has no 64 bit comparison, so ⌈ and ⌊ are left to the interpreter. */
+static const struct isa sse2 = {
+	2, sse_load, sse_broadcast, sse_store, { sse_add, sse_sub, NULL, NULL },
+	sse_zero_acc, sse_epilogue
+};
+static const struct isa avx2 = {
+	4, avx_load, avx_broadcast, avx_store,
+	{ avx_add, avx_sub, avx_max, avx_min }, avx_zero_acc, avx_epilogue
+};
+
+/* Registers needed to evaluate each node, Sethi-Ullman. */
+static void count_needs(const struct jit_node* prog, size_t count,
+		unsigned char* need)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (prog[i].op >= JIT_ADD) {
+			const unsigned l = need[prog[i].arg], r = need[i - 1];
+			need[i] = (unsigned char)(l == r ? l + 1 : l > r ? l : r);
+		} else {
+			need[i] = 1;
+		}
+	}
+}
+
+/* Emits node n so its value ends up in register base. */
+static void gen(struct code* c, const struct isa* isa,
+		const struct jit_node* prog, const unsigned char* need,
+		size_t n, int base)
+{
+	switch (prog[n].op) {
+	case JIT_VECTOR:
+		byte(c, 0x4C); /* mov r8, [rsi + 8 * arg] */
+		byte(c, 0x8B);
+		modrm(c, R8, mem_disp(RSI, (int32_t)(8 * prog[n].arg)));
+		isa->load(c, base, mem_index(R8, RAX));
+		break;
+	case JIT_SCALAR:
+		isa->broadcast(c, base, mem_disp(RDX, (int32_t)(8 * prog[n].arg)));
+		break;
+	default: {
+		const size_t l = prog[n].arg, r = n - 1;
+		/* The operand needing more registers goes first. */
+		const int left_first = need[l] >= need[r];
+		gen(c, isa, prog, need, left_first ? l : r, base);
+		gen(c, isa, prog, need, left_first ? r : l, base + 1);
+		isa->dyads[prog[n].op - JIT_ADD](c, base,
+			left_first ? base : base + 1, left_first ? base + 1 : base);
+		break;
+	}
+	}
+}
+
+static struct code compile(const struct isa* isa, const struct jit_node* prog,
+		size_t count)
+{
+	struct code c = { NULL, 0, 0 };
+	size_t loop, skip;
+	unsigned char need[JIT_MAX_NODES];
+	count_needs(prog, count, need);
+	if (need[count - 1] > STACK_REGS) {
+		return c;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (prog[i].op >= JIT_ADD && !isa->dyads[prog[i].op - JIT_ADD]) {
+			return c;
+		}
+	}
+	byte(&c, 0x31); /* xor eax, eax */
+	byte(&c, 0xC0);
+	isa->zero_acc(&c);
+	byte(&c, 0x48); /* test rcx, rcx */
+	byte(&c, 0x85);
+	byte(&c, 0xC9);
+	byte(&c, 0x0F); /* jz done, patched below */
+	byte(&c, 0x84);
+	skip = c.len;
+	u32(&c, 0);
+	loop = c.len;
+	gen(&c, isa, prog, need, count - 1, 0);
+	isa->store(&c, mem_index(RDI, RAX), 0);
+	byte(&c, 0x48); /* add rax, lanes */
+	byte(&c, 0x83);
+	byte(&c, 0xC0);
+	byte(&c, (unsigned)isa->lanes);
+	byte(&c, 0x48); /* cmp rax, rcx */
+	byte(&c, 0x39);
+	byte(&c, 0xC8);
+	jump_rel32(&c, 0x2, loop); /* jb loop */
+	{
+		const uint32_t rel = (uint32_t)(c.len - (skip + 4));
+		memcpy(&c.p[skip], &rel, sizeof rel);
+	}
+	isa->epilogue(&c);
+	byte(&c, 0xC3); /* ret */
+	return c;
+}
+
+/* Copies code into its own executable mapping. */
+static jit_fn install(struct code* c)
+{
+	void* p = mmap(NULL, c->len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	jit_fn fn;
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	memcpy(p, c->p, c->len);
+	if (mprotect(p, c->len, PROT_READ | PROT_EXEC)) {
+		munmap(p, c->len);
+		return NULL;
+	}
+	/* Object to function pointer: fine on every x86-64 ABI. */
+	memcpy(&fn, &p, sizeof fn);
+	return fn;
+}
+
+/* Compiled kernels, chained by hash of their programs. Never freed. */
+struct kernel {
+	struct kernel* next;
+	uint64_t hash;
+	size_t count;
+	jit_fn fn; /* NULL if the program can't be compiled. */
+	struct jit_node prog[];
+};
+
+#define KERNEL_BUCKETS 256
+static struct kernel* kernels[KERNEL_BUCKETS];
+static pthread_mutex_t kernels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t hash_prog(const struct jit_node* prog, size_t count)
+{
+	uint64_t h = 0xCBF29CE484222325ull; /* FNV-1a */
+	for (size_t i = 0; i < count; ++i) {
+		h = (h ^ prog[i].op) * 0x100000001B3ull;
+		h = (h ^ prog[i].arg) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+static int same_prog(const struct jit_node* a, const struct jit_node* b,
+		size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (a[i].op != b[i].op || a[i].arg != b[i].arg) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static const struct isa* detect(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? &avx2 : &sse2;
+}
+
+jit_fn jit_kernel(const struct jit_node* prog, size_t count, size_t* lanes)
+{
+	static const struct isa* isa;
+	const uint64_t h = hash_prog(prog, count);
+	struct kernel* k;
+	if (count == 0 || count > JIT_MAX_NODES) {
+		return NULL;
+	}
+	pthread_mutex_lock(&kernels_lock);
+	if (!isa) {
+		isa = detect();
+	}
+	*lanes = isa->lanes;
+	for (k = kernels[h % KERNEL_BUCKETS]; k; k = k->next) {
+		if (k->hash == h && k->count == count
+				&& same_prog(k->prog, prog, count)) {
+			pthread_mutex_unlock(&kernels_lock);
+			return k->fn;
+		}
+	}
+	k = mem_alloc(sizeof *k + count * sizeof *prog);
+	assert(k); /* TODO: Error handling */
+	k->hash = h;
+	k->count = count;
+	memcpy(k->prog, prog, count * sizeof *prog);
+	{
+		struct code c = compile(isa, prog, count);
+		k->fn = c.len ? install(&c) : NULL;
+		mem_dealloc(c.p);
+	}
+	k->next = kernels[h % KERNEL_BUCKETS];
+	kernels[h % KERNEL_BUCKETS] = k;
+	pthread_mutex_unlock(&kernels_lock);
+	return k->fn;
+}
+
+#else /* No code generator for this target. */
+
+jit_fn jit_kernel(const struct jit_node* prog, size_t count, size_t* lanes)
+{
+	(void)prog;
+	(void)count;
+	*lanes = 1;
+	return NULL;
+}
+
+#endif
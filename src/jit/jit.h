@@ -0,0 +1,48 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <assert.h>		/* assert() */
+#include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint32_t */
+#include "mem/mem.h"	/* mem_alloc(), mem_dealloc() */
+
+/*
+ * Compiles fused elementwise integer expressions to native x86-64 loops,
+ * using AVX2 when the CPU has it and SSE2 otherwise. Elsewhere (and under
+ * emcc) nothing compiles and callers fall back to the interpreter.
+*/
+
+/* Limits on what is compiled; larger expressions are interpreted. */
+#define JIT_MAX_NODES 256
+#define JIT_MAX_LEAVES 64
+
+enum jit_op {
+	JIT_VECTOR, /* arg indexes the kernel's vecs. */
+	JIT_SCALAR, /* arg indexes the kernel's scalars, broadcast. */
+	/* Dyads: the left operand is node arg, the right the node before. */
+	JIT_ADD,
+	JIT_SUB,
+	JIT_MAX, /* Only with AVX2, which compares 64 bit integers. */
+	JIT_MIN,
+	JIT_OPS
+};
+
+/* One step of a post-order program, as in the flat AST. */
+struct jit_node {
+	unsigned char op;
+	uint32_t arg;
+};
+
+/*
+ * Computes n elements (a multiple of the kernel's lanes) into out. Returns
+ * nonzero if any element overflowed, in which case out is garbage.
+*/
+typedef int (*jit_fn)(long* out, const long* const* vecs,
+		const long* scalars, size_t n);
+
+/*
+ * Returns the kernel for prog, compiling it the first time the program (its
+ * shape and leaf types) is seen, and sets lanes. NULL if it can't compile.
+*/
+jit_fn jit_kernel(const struct jit_node* prog, size_t count, size_t* lanes);
+#endif
@@ -1,29 +1,179 @@
 #include "lex.h"
 
-struct lexer; /* Must forward declare for the sake of typedefs. */
-
 /*
- * Unfortunately, there are no recursive typedefs in C, so we use a dummy.
- * Source: comp.lang.c FAQ 1.22 (http://www.c-faq.com/decl/recurfuncp.html)
+ * The lexer is a DFA over character classes. Every input byte is mapped to a
+ * class by a 256 entry table, and the class and current state index a
+ * transition table, so the inner loop is two loads and a compare per byte.
+ * States below S_START are accepting: the token is the text consumed so far,
+ * and the byte that caused the transition is left for the next token.
 */
-typedef int (*state_func)(struct lexer *); /* Dummy function pointer. */
-typedef state_func (*state_func_ptr)(struct lexer *);
 
-static state_func lex_start(struct lexer *);
+/* Character classes. */
+enum cclass {
+	C_BAD, /* Zero, so unlisted bytes are rejected. */
+	C_END,
+	C_SPACE,
+	C_DIGIT,
+	C_GLYPH, /* Single byte operator glyph. */
+	C_LPAREN,
+	C_RPAREN,
+	C_CONT, /* UTF-8 continuation byte. */
+	C_LEAD2, /* UTF-8 lead bytes of 2, 3 and 4 byte sequences. */
+	C_LEAD3,
+	C_LEAD4,
+	C_ALPHA, /* Letters and _, which start names. */
+	C_COUNT
+};
+
+enum state {
+	A_ERROR, /* Zero, so unlisted transitions are rejected. */
+	A_EOF,
+	A_NUMBER,
+	A_GLYPH,
+	A_LPAREN,
+	A_RPAREN,
+	A_NAME,
+	S_START, /* First non accepting state. */
+	S_SPACE,
+	S_NUMBER,
+	S_GLYPH,
+	S_LPAREN,
+	S_RPAREN,
+	S_NAME,
+	S_NEED1, /* Inside a UTF-8 sequence, expecting 1, 2 or 3 more bytes. */
+	S_NEED2,
+	S_NEED3,
+	STATE_COUNT
+};
+
+#define ACCEPTING(s) ((s) < S_START)
+
+#define DIGITS(x) \
+	['0'] = x, ['1'] = x, ['2'] = x, ['3'] = x, ['4'] = x, \
+	['5'] = x, ['6'] = x, ['7'] = x, ['8'] = x, ['9'] = x
+#define LETTERS(x) \
+	['A'] = x, ['B'] = x, ['C'] = x, ['D'] = x, ['E'] = x, ['F'] = x, \
+	['G'] = x, ['H'] = x, ['I'] = x, ['J'] = x, ['K'] = x, ['L'] = x, \
+	['M'] = x, ['N'] = x, ['O'] = x, ['P'] = x, ['Q'] = x, ['R'] = x, \
+	['S'] = x, ['T'] = x, ['U'] = x, ['V'] = x, ['W'] = x, ['X'] = x, \
+	['Y'] = x, ['Z'] = x, \
+	['a'] = x, ['b'] = x, ['c'] = x, ['d'] = x, ['e'] = x, ['f'] = x, \
+	['g'] = x, ['h'] = x, ['i'] = x, ['j'] = x, ['k'] = x, ['l'] = x, \
+	['m'] = x, ['n'] = x, ['o'] = x, ['p'] = x, ['q'] = x, ['r'] = x, \
+	['s'] = x, ['t'] = x, ['u'] = x, ['v'] = x, ['w'] = x, ['x'] = x, \
+	['y'] = x, ['z'] = x, ['_'] = x
+#define RANGE16(b, x) \
+	[b + 0x0] = x, [b + 0x1] = x, [b + 0x2] = x, [b + 0x3] = x, \
+	[b + 0x4] = x, [b + 0x5] = x, [b + 0x6] = x, [b + 0x7] = x, \
+	[b + 0x8] = x, [b + 0x9] = x, [b + 0xA] = x, [b + 0xB] = x, \
+	[b + 0xC] = x, [b + 0xD] = x, [b + 0xE] = x, [b + 0xF] = x
+
+static const unsigned char cclass[256] = {
+	['\0'] = C_END,
+	[' '] = C_SPACE, ['\t'] = C_SPACE, ['\n'] = C_SPACE,
+	['\v'] = C_SPACE, ['\f'] = C_SPACE, ['\r'] = C_SPACE,
+	DIGITS(C_DIGIT),
+	LETTERS(C_ALPHA),
+	['+'] = C_GLYPH, ['/'] = C_GLYPH, ['='] = C_GLYPH, ['<'] = C_GLYPH,
+	['>'] = C_GLYPH, ['~'] = C_GLYPH, ['['] = C_GLYPH, [']'] = C_GLYPH,
+	['.'] = C_GLYPH, ['-'] = C_GLYPH, ['|'] = C_GLYPH, ['*'] = C_GLYPH,
+	['('] = C_LPAREN,
+	[')'] = C_RPAREN,
+	RANGE16(0x80, C_CONT), RANGE16(0x90, C_CONT),
+	RANGE16(0xA0, C_CONT), RANGE16(0xB0, C_CONT),
+	RANGE16(0xC0, C_LEAD2), RANGE16(0xD0, C_LEAD2),
+	RANGE16(0xE0, C_LEAD3),
+	[0xF0] = C_LEAD4, [0xF1] = C_LEAD4, [0xF2] = C_LEAD4, [0xF3] = C_LEAD4,
+	/* 0xC0, 0xC1 and 0xF5 up can't start valid UTF-8, but glyph lookup
+	 * rejects anything not in the table anyway. */
+};
+
+/* Transitions out of the start state, shared with runs of whitespace. */
+#define START_ROW { \
+	[C_END] = A_EOF, \
+	[C_SPACE] = S_SPACE, \
+	[C_DIGIT] = S_NUMBER, \
+	[C_GLYPH] = S_GLYPH, \
+	[C_LPAREN] = S_LPAREN, \
+	[C_RPAREN] = S_RPAREN, \
+	[C_LEAD2] = S_NEED1, \
+	[C_LEAD3] = S_NEED2, \
+	[C_LEAD4] = S_NEED3, \
+	[C_ALPHA] = S_NAME, \
+}
+/* A complete token, whatever follows it. */
+#define ACCEPT_ROW(x) { x, x, x, x, x, x, x, x, x, x, x, x }
+
+static const unsigned char delta[STATE_COUNT][C_COUNT] = {
+	[S_START] = START_ROW,
+	[S_SPACE] = START_ROW,
+	[S_NUMBER] = {
+		[C_BAD] = A_NUMBER, [C_END] = A_NUMBER, [C_SPACE] = A_NUMBER,
+		[C_DIGIT] = S_NUMBER, [C_GLYPH] = A_NUMBER, [C_LPAREN] = A_NUMBER,
+		[C_RPAREN] = A_NUMBER, [C_CONT] = A_NUMBER, [C_LEAD2] = A_NUMBER,
+		[C_LEAD3] = A_NUMBER, [C_LEAD4] = A_NUMBER, [C_ALPHA] = A_NUMBER,
+	},
+	[S_NAME] = { /* Letters, then letters, digits and _. */
+		[C_BAD] = A_NAME, [C_END] = A_NAME, [C_SPACE] = A_NAME,
+		[C_DIGIT] = S_NAME, [C_GLYPH] = A_NAME, [C_LPAREN] = A_NAME,
+		[C_RPAREN] = A_NAME, [C_CONT] = A_NAME, [C_LEAD2] = A_NAME,
+		[C_LEAD3] = A_NAME, [C_LEAD4] = A_NAME, [C_ALPHA] = S_NAME,
+	},
+	[S_GLYPH] = ACCEPT_ROW(A_GLYPH),
+	[S_LPAREN] = ACCEPT_ROW(A_LPAREN),
+	[S_RPAREN] = ACCEPT_ROW(A_RPAREN),
+	[S_NEED1] = { [C_CONT] = S_GLYPH },
+	[S_NEED2] = { [C_CONT] = S_NEED1 },
+	[S_NEED3] = { [C_CONT] = S_NEED2 },
+};
+
+/*
+ * Glyphs the lexer knows, single byte or UTF-8. To add an APL primitive,
+ * list it here (and, for ASCII, mark it C_GLYPH in cclass).
+*/
+static const struct glyph {
+	const char* text;
+	enum token_type type;
+} glyphs[] = {
+	{ "+", TOKEN_OPERATOR },
+	{ "-", TOKEN_OPERATOR },
+	{ "×", TOKEN_OPERATOR },
+	{ "÷", TOKEN_OPERATOR },
+	{ "⌈", TOKEN_OPERATOR },
+	{ "⌊", TOKEN_OPERATOR },
+	{ "|", TOKEN_OPERATOR },
+	{ "*", TOKEN_OPERATOR },
+	{ "/", TOKEN_SLASH },
+	{ "=", TOKEN_OPERATOR },
+	{ "≠", TOKEN_OPERATOR },
+	{ "<", TOKEN_OPERATOR },
+	{ "≤", TOKEN_OPERATOR },
+	{ ">", TOKEN_OPERATOR },
+	{ "≥", TOKEN_OPERATOR },
+	{ "∧", TOKEN_OPERATOR },
+	{ "∨", TOKEN_OPERATOR },
+	{ "~", TOKEN_OPERATOR },
+	{ "⍳", TOKEN_OPERATOR },
+	{ "⍋", TOKEN_OPERATOR },
+	{ "⍒", TOKEN_OPERATOR },
+	{ "∊", TOKEN_OPERATOR },
+	{ "∪", TOKEN_OPERATOR },
+	{ "∘", TOKEN_JOT },
+	{ ".", TOKEN_DOT },
+	{ "[", TOKEN_LBRACKET },
+	{ "]", TOKEN_RBRACKET },
+	{ "⍺", TOKEN_ARGUMENT },
+	{ "⍵", TOKEN_ARGUMENT },
+	{ "←", TOKEN_ASSIGN },
+};
 
-#define LOOKAHEAD 2
 struct lexer {
-	char* str;
-	state_func_ptr state;
-#if 0
-	size_t buf_read;
-	size_t buf_write;
-	char buf[LOOKAHEAD];
-#endif
+	const char* str;
+	const char* in; /* Start of input, for token offsets. */
+	const char* in_name;
+	size_t token_offset;
 	size_t token_len;
 	enum token_type token_type;
-	int emitted;
-	const char* in_name;
 	char token_str[2048];
 };
 
@@ -32,7 +182,6 @@ struct lexer* lexer_make()
 	struct lexer* l = mem_alloc(sizeof *l + token_size());
 	assert(l); /* TODO: Error handling */
 	memset(l, 0, sizeof *l + token_size());
-	l->state = lex_start;
 	return l;
 }
 
@@ -42,149 +191,103 @@ void lexer_free(struct lexer* l)
 	free(l);
 }
 
-static void append_char(struct lexer* l, const char c)
-{
-	l->token_str[l->token_len++] = c;
-	assert(l->token_len < 2047); /* TODO: Error handling. */
-}
-
-static void append_cstr(struct lexer* l, const char* str)
+static void emit_token(struct lexer* l, enum token_type type,
+		const char* s, size_t len)
 {
-	const size_t str_len = strlen(str);
-	assert(l->token_len + str_len < 2047); /* TODO: Error handling. */
-	memcpy(&l->token_str[l->token_len], str, str_len);
-	l->token_len += str_len;
-}
-
-static void emit_token(struct lexer* l, enum token_type type)
-{
-	/* Cache allocated tokens inside the lexer to avoid mem_alloc()s */
-	/* TODO: Remove copy here by refactoring empty_string & token_make? */
+	assert(len < 2047); /* TODO: Error handling. */
+	memcpy(l->token_str, s, len);
+	l->token_str[len] = '\0';
+	l->token_len = len;
 	l->token_type = type;
-	l->token_str[l->token_len] = '\0';
-	l->emitted = 1;
-	return;
-}
-
-static void cleanup_token_cache(struct lexer* l)
-{
-	l->token_len = 0;
-	l->emitted = 0;
 }
 
-static char next(struct lexer* l)
+static int lookup_glyph(const char* s, size_t len, enum token_type* type)
 {
-	return *(l->str++);
-#if 0
-	char res;
-	if (l->buf_write == l->buf_read) {
-		return *(l->str++);
+	for (size_t i = 0; i < sizeof glyphs / sizeof glyphs[0]; ++i) {
+		if (strlen(glyphs[i].text) == len && !memcmp(glyphs[i].text, s, len)) {
+			*type = glyphs[i].type;
+			return 1;
+		}
 	}
-	res = l->buf[l->buf_read];
-	l->buf_read = (l->buf_read + 1) % LOOKAHEAD;
-	return res;
-#endif
-}
-
-static void backup(struct lexer* l, char c)
-{
-	l->str--;
-#if 0
-	const size_t next = (l->buf_write + 1) % LOOKAHEAD;
-	assert(next != l->buf_read); /* TODO: Error handling. Full. */
-	l->buf[l->buf_write] = c;
-	l->buf_write = next;
-#endif
+	return 0;
 }
 
-static state_func lex_space(struct lexer* l)
+/* Fails the parse, rather than ending the input early. */
+static void lex_error(const char* at, size_t len)
 {
-	char c = next(l);
-	while (isspace(c)) {
-		c = next(l);
-	}
-	backup(l, c);
-	return (state_func)lex_start;
+	fprintf(stdout, "Error: bad character %.*s.\n", (int)len, at);
+	exit(EXIT_FAILURE); /* TODO: Error handling */
 }
 
-static state_func lex_number(struct lexer* l)
+/* Runs the DFA from l->str to the end of the next token. */
+static void lex_scan(struct lexer* l)
 {
-	char c = next(l);
-	while (isdigit(c)) {
-		append_char(l, c);
-		c = next(l);
+	const unsigned char* s = (const unsigned char*)l->str;
+	const unsigned char* start = s;
+	unsigned char state = S_START;
+	for (;;) {
+		const unsigned char next = delta[state][cclass[*s]];
+		if (ACCEPTING(next)) {
+			state = next;
+			break;
+		}
+		if (next == S_SPACE) { /* Whitespace belongs to no token. */
+			start = s + 1;
+		}
+		state = next;
+		s++;
 	}
-	backup(l, c);
-	emit_token(l, TOKEN_NUMBER);
-	return (state_func)lex_start;
-}
-
-static state_func lex_operator(struct lexer* l)
-{
-	char c = next(l);
-	if (c != '+') {
-		return NULL; /* TODO: Error handling */
+	l->str = (const char*)s;
+	l->token_offset = (const char*)start - l->in;
+	switch (state) {
+	case A_EOF:
+		emit_token(l, TOKEN_EOF, "End of string", strlen("End of string"));
+		break;
+	case A_NUMBER:
+		emit_token(l, TOKEN_NUMBER, (const char*)start, s - start);
+		break;
+	case A_NAME:
+		emit_token(l, TOKEN_NAME, (const char*)start, s - start);
+		break;
+	case A_LPAREN:
+		emit_token(l, TOKEN_LPAREN, "(", 1);
+		break;
+	case A_RPAREN:
+		emit_token(l, TOKEN_RPAREN, ")", 1);
+		break;
+	case A_GLYPH: {
+		enum token_type type;
+		if (!lookup_glyph((const char*)start, s - start, &type)) {
+			lex_error((const char*)start, s - start);
+			break;
+		}
+		emit_token(l, type, (const char*)start, s - start);
+		break;
 	}
-	append_char(l, c);
-	emit_token(l, TOKEN_OPERATOR);
-	return (state_func)lex_start;
-}
-
-static state_func lex_start(struct lexer* l)
-{
-	char c = next(l);
-	if (isspace(c)) {
-		backup(l, c);
-		return (state_func)lex_space;
-	} else if (isdigit(c)) {
-		backup(l, c);
-		return (state_func)lex_number;
-	} else if (c == '+') {
-		backup(l, c);
-		return (state_func)lex_operator;
-	} else if (c == '(') {
-		append_char(l, '(');
-		emit_token(l, TOKEN_LPAREN);
-		return (state_func)lex_start;
-	} else if (c == ')') {
-		append_char(l, '(');
-		emit_token(l, TOKEN_RPAREN);
-		return (state_func)lex_start;
-	} else if (c == '\0') {
-		append_cstr(l, "End of string");
-		emit_token(l, TOKEN_EOF);
-		return NULL;
-	} else {
-		fprintf(stderr, "Error. Bad character: %c\n", c);
-		return NULL; /* TODO: Error handling */
+	default:
+		lex_error((const char*)s, 1);
+		break;
 	}
 }
 
 token lex_token(struct lexer* l, token prev)
 {
-	token t;
 	assert(l);
-	while (l->state != NULL && !l->emitted) {
-		l->state = (state_func_ptr) l->state(l);
-	}
-	t = token_make(
+	lex_scan(l);
+	return token_make(
 		l->token_type,
 		l->token_str,
 		l->token_len,
+		l->token_offset,
 		prev
 	);
-	cleanup_token_cache(l);
-	return t;
 }
 
 void lexer_init(struct lexer* l, char* in, char* in_name)
 {
 	assert(l);
-	l->state = lex_start;
-	l->token_len = l->emitted = 0;
-#if 0
-	l->buf_read = l->buf_write = l->token_len = l->emitted = 0;
-#endif
+	l->token_len = 0;
 	l->str = in;
+	l->in = in;
 	l->in_name = in_name;
 }
@@ -1,14 +1,30 @@
 #include "mem.h"
 
+/*
+ * Per thread, so counting needs no synchronization. Pool tasks credit what
+ * they allocate on other threads to the thread that ran the pool.
+*/
+static _Thread_local size_t allocated;
+
 void* mem_alloc(size_t size)
 {
+	allocated += size;
 	return malloc(size);
 }
 void* mem_realloc(void* ptr, size_t size)
 {
+	allocated += size;
 	return realloc(ptr, size);
 }
 void mem_dealloc(void* ptr)
 {
 	free(ptr);
 }
+size_t mem_allocated(void)
+{
+	return allocated;
+}
+void mem_credit(size_t bytes)
+{
+	allocated += bytes;
+}
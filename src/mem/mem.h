@@ -4,3 +4,9 @@
 void* mem_alloc(size_t size);
 void* mem_realloc(void* ptr, size_t size);
 void mem_dealloc(void* ptr);
+/*
+ * Bytes requested by this thread so far, and by pool tasks it ran on other
+ * threads, for profiling.
+*/
+size_t mem_allocated(void);
+void mem_credit(size_t bytes); /* Counts bytes as this thread's. */
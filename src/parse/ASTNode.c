@@ -1,150 +1,1018 @@
 
 #include "parse.h"
+#include "prof/prof.h"
+#include "jit/jit.h"
 
-struct ASTNode_ {
-	enum { AST_BINOP, AST_UNOP, AST_NUMBER, AST_VECTOR } type;
-	union {
-		struct { /* Binop */
-			ASTNode left;
-			char *dyad;
-			ASTNode right;
-		};
-		struct { /* Unop */
-			char *monad;
-			ASTNode rest;
-		};
-		Value value; /* Number, vector */
-	};
+enum ast_type {
+	AST_BINOP, AST_OUTER, AST_INNER, AST_UNOP, AST_REDUCE, AST_ASSIGN, AST_INDEX, AST_SORT,
+	AST_NUMBER, AST_VECTOR, AST_ARGUMENT, AST_NAME
 };
 
-/* Uniform allocation (Can make a pool allocator). */
-ASTNode make_node(void)
+/*
+ * Nodes are kept as parallel arrays in one buffer, in post-order. An operand
+ * is therefore always evaluated before the node using it, and a forward sweep
+ * with a stack of Values evaluates the tree without recursion. A binop's
+ * right operand is the node just before it; arg holds its left operand.
+ * Outer products ⍺∘.f⍵, inner products ⍺f.g⍵ and indexing x[i] are laid out
+ * the same, with ⍺ and x as the left operand. An inner product's op holds
+ * both functions, f in the low byte and g in the high. The idiom
+ * x[⍋x] (or x[⍒x]) becomes a sort node over x, with op 1 for descending. Unops
+ * and reductions take the node just before them. For literals arg is the
+ * offset of the literal in pool, which holds an element count followed by
+ * the elements. For arguments it is 0 for ⍺ and 1 for ⍵. For names, and
+ * assignments (which take the node before them), it is the symbol in ws.
+ * from and to give the bytes of the input each node was parsed from, for
+ * diagnostics.
+*/
+struct AST_ {
+	size_t count; /* Nodes used. */
+	size_t cap; /* Nodes allocated. */
+	const char* in_name;
+	struct Workspace* ws; /* Where names are interned and bound. */
+	uint32_t* arg;
+	uint32_t* from;
+	uint32_t* to;
+	uint16_t* op;
+	unsigned char* kind;
+	size_t pool_use;
+	size_t pool_cap;
+	unsigned long* pool;
+	size_t depth; /* Stack height after the last node. */
+	size_t max_depth; /* Stack needed to evaluate the tree. */
+	Value* stack;
+};
+
+/* Bytes per node, across the parallel arrays. */
+#define NODE_BYTES (3 * sizeof(uint32_t) + sizeof(uint16_t) + 1)
+
+/* An inner product's functions, packed into its op. */
+#define INNER_OP(f, g) ((uint16_t)((f) | (g) << 8))
+#define OP_F(op) ((op) & 0xFF) /* Also any other node's op. */
+#define OP_G(op) ((op) >> 8)
+
+/* Primitive functions, indexed by op. */
+static Value identity(Value v)
+{
+	return value_reference(v);
+}
+
+/* Which of a primitive's forms apply to each element on its own. */
+enum { SCALAR_DYAD = 1, SCALAR_MONAD = 2, ASSOCIATIVE = 4 };
+
+static const struct prim {
+	const char* glyph;
+	Value (*dyad)(Value, Value);
+	Value (*monad)(Value);
+	Value (*reduce)(Value);
+	int jit; /* The dyad's enum jit_op, or -1 if it isn't compiled. */
+	unsigned char scalar; /* SCALAR_ flags, and whether the dyad associates. */
+} prims[] = {
+	{ "+", value_add, identity, value_sum, JIT_ADD,
+		SCALAR_DYAD | SCALAR_MONAD | ASSOCIATIVE },
+	{ "-", value_subtract, value_negate, value_reduce_subtract, JIT_SUB,
+		SCALAR_DYAD | SCALAR_MONAD },
+	{ "×", value_times, value_signum, value_reduce_times, -1,
+		SCALAR_DYAD | SCALAR_MONAD | ASSOCIATIVE },
+	{ "÷", value_divide, value_reciprocal, value_reduce_divide, -1,
+		SCALAR_DYAD | SCALAR_MONAD },
+	{ "⌈", value_max, value_ceiling, value_reduce_max, JIT_MAX,
+		SCALAR_DYAD | SCALAR_MONAD | ASSOCIATIVE },
+	{ "⌊", value_min, value_floor, value_reduce_min, JIT_MIN,
+		SCALAR_DYAD | SCALAR_MONAD | ASSOCIATIVE },
+	{ "|", value_residue, value_magnitude, value_reduce_residue, -1,
+		SCALAR_DYAD | SCALAR_MONAD },
+	{ "*", value_power, value_exp, value_reduce_power, -1,
+		SCALAR_DYAD | SCALAR_MONAD },
+	{ "=", value_equal, NULL, NULL, -1, SCALAR_DYAD },
+	{ "≠", value_not_equal, NULL, NULL, -1, SCALAR_DYAD },
+	{ "<", value_less, NULL, NULL, -1, SCALAR_DYAD },
+	{ "≤", value_less_equal, NULL, NULL, -1, SCALAR_DYAD },
+	{ ">", value_greater, NULL, NULL, -1, SCALAR_DYAD },
+	{ "≥", value_greater_equal, NULL, NULL, -1, SCALAR_DYAD },
+	{ "∧", value_and, NULL, value_all, -1, SCALAR_DYAD | ASSOCIATIVE },
+	{ "∨", value_or, NULL, value_any, -1, SCALAR_DYAD | ASSOCIATIVE },
+	{ "~", NULL, value_not, NULL, -1, SCALAR_MONAD },
+	{ "⍳", value_index_of, value_iota, NULL, -1, 0 },
+	{ "⍋", NULL, value_grade_up, NULL, -1, 0 },
+	{ "⍒", NULL, value_grade_down, NULL, -1, 0 },
+	{ "∊", value_member, NULL, NULL, -1, 0 },
+	{ "∪", NULL, value_unique, NULL, -1, 0 },
+	{ "/", value_compress, NULL, NULL, -1, 0 }, /* Compress. */
+};
+
+static int use_jit;
+
+static const char* const arguments[] = { "⍺", "⍵" };
+
+static unsigned char lookup_prim(const char* glyph)
+{
+	for (size_t i = 0; i < sizeof prims / sizeof prims[0]; ++i) {
+		if (!strcmp(prims[i].glyph, glyph)) {
+			return (unsigned char)i;
+		}
+	}
+	assert(0); /* TODO: Error handling. Lexer only emits known glyphs. */
+	return 0;
+}
+
+enum form { FORM_DYAD, FORM_MONAD, FORM_REDUCE };
+
+/* Like lookup_prim(), for a form glyph must have (there's no monadic =). */
+static unsigned char lookup_form(const char* glyph, enum form f)
+{
+	static const char* const names[] = { "dyadic", "monadic", "reduction" };
+	const unsigned char op = lookup_prim(glyph);
+	const int has = f == FORM_DYAD ? prims[op].dyad != NULL
+		: f == FORM_MONAD ? prims[op].monad != NULL
+		: prims[op].reduce != NULL;
+	if (!has) {
+		fprintf(stdout, "Error: %s has no %s form.\n", glyph, names[f]);
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	return op;
+}
+
+AST ast_make(void)
+{
+	AST t = mem_alloc(sizeof *t);
+	assert(t); /* TODO: Error handling */
+	memset(t, 0, sizeof *t);
+	return t;
+}
+
+/* The whole tree is four blocks, regardless of its size. */
+void ast_free(AST t)
+{
+	if (!t) {
+		return;
+	}
+	mem_dealloc(t->arg);
+	mem_dealloc(t->pool);
+	mem_dealloc(t->stack);
+	mem_dealloc(t);
+}
+
+/* Points the node arrays into buf, which has room for cap nodes. */
+static void carve_nodes(AST t, void* buf, size_t cap)
+{
+	t->arg = buf;
+	t->from = t->arg + cap;
+	t->to = t->from + cap;
+	t->op = (uint16_t*)(t->to + cap);
+	t->kind = (unsigned char*)(t->op + cap);
+	t->cap = cap;
+}
+
+/* Copies the nodes of src into dst, which must have room for them. */
+static void copy_nodes(AST dst, const struct AST_* src)
+{
+	memcpy(dst->arg, src->arg, src->count * sizeof *src->arg);
+	memcpy(dst->from, src->from, src->count * sizeof *src->from);
+	memcpy(dst->to, src->to, src->count * sizeof *src->to);
+	memcpy(dst->kind, src->kind, src->count * sizeof *src->kind);
+	memcpy(dst->op, src->op, src->count * sizeof *src->op);
+}
+
+/* Memory held by the tree's nodes and literals. */
+size_t ast_bytes(AST t)
+{
+	return sizeof *t + t->count * NODE_BYTES + t->pool_use * sizeof *t->pool;
+}
+
+AST ast_copy(AST t)
+{
+	AST cpy = ast_make();
+	void* buf = mem_alloc(t->count * NODE_BYTES);
+	assert(buf); /* TODO: Error handling */
+	carve_nodes(cpy, buf, t->count);
+	copy_nodes(cpy, t);
+	cpy->count = t->count;
+	cpy->in_name = t->in_name;
+	cpy->ws = t->ws;
+	cpy->pool_use = cpy->pool_cap = t->pool_use;
+	if (t->pool_use) { /* Trees of names alone have no literals. */
+		cpy->pool = mem_alloc(t->pool_use * sizeof *t->pool);
+		assert(cpy->pool); /* TODO: Error handling */
+		memcpy(cpy->pool, t->pool, t->pool_use * sizeof *t->pool);
+	}
+	cpy->depth = t->depth;
+	cpy->max_depth = t->max_depth;
+	return cpy;
+}
+
+/*
+ * The flat form is already normalized: spacing and redundant parentheses
+ * leave no trace in it (besides source spans, which are ignored), so equal
+ * trees mean equal expressions. Names compare by symbol, not binding; see
+ * ast_versions().
+*/
+int ast_equal(AST a, AST b)
+{
+	return a->count == b->count && a->pool_use == b->pool_use
+		&& !memcmp(a->arg, b->arg, a->count * sizeof *a->arg)
+		&& !memcmp(a->kind, b->kind, a->count)
+		&& !memcmp(a->op, b->op, a->count * sizeof *a->op)
+		&& (!a->pool_use
+			|| !memcmp(a->pool, b->pool, a->pool_use * sizeof *a->pool));
+}
+
+static uint64_t hash_word(uint64_t h, uint64_t w)
+{
+	h ^= w * 0x9E3779B97F4A7C15ull;
+	h = (h << 31 | h >> 33) * 0xC2B2AE3D27D4EB4Full;
+	return h;
+}
+
+uint64_t ast_fingerprint(AST t)
 {
-	ASTNode n = mem_alloc(sizeof *n);
-	assert(n); /* TODO: Error handling */
+	uint64_t h = t->count;
+	for (size_t i = 0; i < t->count; ++i) {
+		h = hash_word(h, t->kind[i] | (uint64_t)t->op[i] << 8
+			| (uint64_t)t->arg[i] << 24);
+	}
+	for (size_t i = 0; i < t->pool_use; ++i) {
+		h = hash_word(h, t->pool[i]);
+	}
+	for (size_t i = 0; i < t->count; ++i) { /* What names are bound to. */
+		if (t->kind[i] == AST_NAME) {
+			h = hash_word(h, ws_version(t->ws, t->arg[i]));
+		}
+	}
+	h ^= h >> 29; /* Final avalanche, so every bit depends on every input. */
+	h *= 0xBF58476D1CE4E5B9ull;
+	return h ^ h >> 32;
+}
+
+size_t ast_versions(AST t, uint64_t* versions)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < t->count; ++i) {
+		if (t->kind[i] == AST_NAME) {
+			if (versions) {
+				versions[n] = ws_version(t->ws, t->arg[i]);
+			}
+			n++;
+		}
+	}
 	return n;
 }
 
-/* Returns a char* of the node to string, caller must free. */
-char* Stringify(ASTNode n)
+static void grow_nodes(AST t)
 {
-	char* res = NULL;
-	switch(n->type) {
-	case AST_BINOP: {
-		char* left = Stringify(n->left), *right = Stringify(n->right);
-		res = malloc(
-			(strlen(left) + strlen(n->dyad) + strlen(right) + 1) * sizeof *res
-		);
-		sprintf(res, "%s %s %s", left, n->dyad, right);
-		free(left);
-		free(right);
-		break;
+	const size_t cap = t->cap ? t->cap * 2 : 64;
+	const struct AST_ old = *t;
+	void* buf = mem_alloc(cap * NODE_BYTES);
+	assert(buf); /* TODO: Error handling */
+	carve_nodes(t, buf, cap);
+	if (old.count) {
+		copy_nodes(t, &old);
 	}
-	case AST_UNOP: {
-		char* rest = Stringify(n->rest);
-		res = malloc((strlen(n->monad) + strlen(rest) + 1) * sizeof *res);
-		sprintf(res, "%s %s", n->monad, rest);
-		free(rest);
-		break;
+	mem_dealloc(old.arg);
+}
+
+/* Appends a node which changes the evaluation stack's height by push. */
+static ASTNode add_node(AST t, enum ast_type kind, uint16_t op,
+		uint32_t arg, int push)
+{
+	if (t->count == t->cap) {
+		grow_nodes(t);
 	}
-	case AST_NUMBER: /* FALLTHRU */
-	case AST_VECTOR:
-		res = value_stringify(n->value);
-		break;
-	default:
-		return NULL;
+	t->arg[t->count] = arg;
+	t->from[t->count] = t->to[t->count] = 0;
+	t->kind[t->count] = (unsigned char)kind;
+	t->op[t->count] = op;
+	t->depth += push;
+	if (t->depth > t->max_depth) {
+		t->max_depth = t->depth;
+	}
+	return (ASTNode)t->count++;
+}
+
+static void pool_push(AST t, unsigned long word)
+{
+	if (t->pool_use == t->pool_cap) {
+		t->pool_cap = t->pool_cap ? t->pool_cap * 2 : 64;
+		t->pool = mem_realloc(t->pool, t->pool_cap * sizeof *t->pool);
+		assert(t->pool); /* TODO: Error handling */
 	}
-	assert(res); /* TODO: Error handling. */
+	t->pool[t->pool_use++] = word;
+}
+
+static char* stringify_literal(AST t, ASTNode n)
+{
+	Value v = t->kind[n] == AST_NUMBER
+		? value_make_number(t->pool[t->arg[n] + 1])
+		: value_make_vector(&t->pool[t->arg[n] + 1], t->pool[t->arg[n]]);
+	char* res = value_stringify(v);
+	value_free(v);
 	return res;
 }
 
-Value Eval(ASTNode n)
+/* Returns a char* of the tree to string, caller must free. */
+char* Stringify(AST t)
 {
+	char* res = NULL;
+	char** stack = mem_alloc((t->max_depth + 1) * sizeof *stack);
+	char** sp = stack;
+	assert(stack); /* TODO: Error handling. */
+	for (size_t i = 0; i < t->count; ++i) {
+		const char* glyph = prims[OP_F(t->op[i])].glyph;
+		switch(t->kind[i]) {
+		case AST_BINOP: {
+			/* Left operands that are expressions need parenthesizing. */
+			const int paren = t->kind[t->arg[i]] <= AST_ASSIGN;
+			char* right = *--sp, *left = *--sp;
+			res = malloc(strlen(left) + strlen(glyph) + strlen(right) + 5);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, paren ? "(%s) %s %s" : "%s %s %s", left, glyph, right);
+			free(left);
+			free(right);
+			*sp++ = res;
+			break;
+		}
+		case AST_OUTER: {
+			const int paren = t->kind[t->arg[i]] <= AST_ASSIGN;
+			char* right = *--sp, *left = *--sp;
+			res = malloc(strlen(left) + strlen(glyph) + strlen(right) + 10);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, paren ? "(%s) ∘.%s %s" : "%s ∘.%s %s", left, glyph,
+				right);
+			free(left);
+			free(right);
+			*sp++ = res;
+			break;
+		}
+		case AST_INNER: {
+			const int paren = t->kind[t->arg[i]] <= AST_ASSIGN;
+			const char* g = prims[OP_G(t->op[i])].glyph;
+			char* right = *--sp, *left = *--sp;
+			res = malloc(strlen(left) + strlen(glyph) + strlen(g)
+				+ strlen(right) + 6);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, paren ? "(%s) %s.%s %s" : "%s %s.%s %s", left, glyph, g,
+				right);
+			free(left);
+			free(right);
+			*sp++ = res;
+			break;
+		}
+		case AST_UNOP: {
+			char* rest = *--sp;
+			res = malloc(strlen(glyph) + strlen(rest) + 2);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, "%s %s", glyph, rest);
+			free(rest);
+			*sp++ = res;
+			break;
+		}
+		case AST_REDUCE: {
+			char* rest = *--sp;
+			res = malloc(strlen(glyph) + strlen(rest) + 3);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, "%s/ %s", glyph, rest);
+			free(rest);
+			*sp++ = res;
+			break;
+		}
+		case AST_NUMBER: /* FALLTHRU */
+		case AST_VECTOR:
+			*sp++ = stringify_literal(t, (ASTNode)i);
+			break;
+		case AST_INDEX: {
+			const int paren = t->kind[t->arg[i]] <= AST_ASSIGN;
+			char* idx = *--sp, *x = *--sp;
+			res = malloc(strlen(x) + strlen(idx) + 5);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, paren ? "(%s)[%s]" : "%s[%s]", x, idx);
+			free(x);
+			free(idx);
+			*sp++ = res;
+			break;
+		}
+		case AST_SORT: {
+			const char* glyph = t->op[i] ? "⍒" : "⍋";
+			char* x = *--sp;
+			res = malloc(2 * strlen(x) + strlen(glyph) + 3);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, "%s[%s%s]", x, glyph, x);
+			free(x);
+			*sp++ = res;
+			break;
+		}
+		case AST_ASSIGN: {
+			const char* name = ws_name(t->ws, t->arg[i]);
+			char* rest = *--sp;
+			res = malloc(strlen(name) + strlen(rest) + strlen(" ← ") + 1);
+			assert(res); /* TODO: Error handling. */
+			sprintf(res, "%s ← %s", name, rest);
+			free(rest);
+			*sp++ = res;
+			break;
+		}
+		case AST_ARGUMENT: /* FALLTHRU */
+		case AST_NAME: {
+			const char* name = t->kind[i] == AST_NAME
+				? ws_name(t->ws, t->arg[i]) : arguments[t->arg[i]];
+			res = malloc(strlen(name) + 1);
+			assert(res); /* TODO: Error handling. */
+			strcpy(res, name);
+			*sp++ = res;
+			break;
+		}
+		}
+	}
+	res = sp == stack ? NULL : stack[0];
+	mem_dealloc(stack);
+	return res;
+}
+
+/* Adds one evaluation of node i, which began at start, to prof. */
+static void profile_step(struct Profile* prof, size_t i, uint64_t start,
+		size_t bytes, Value res)
+{
+	struct prof_node* pn = &prof->nodes[i];
+	pn->calls++;
+	pn->excl_ns += prof_now() - start;
+	pn->excl_bytes += mem_allocated() - bytes;
+	pn->elements += value_count(res);
+}
+
+/* Operands are evaluated in their own steps, so inclusive costs add up. */
+static void profile_inclusive(AST t, struct Profile* prof)
+{
+	for (size_t i = 0; i < t->count; ++i) {
+		struct prof_node* pn = &prof->nodes[i];
+		pn->incl_ns = pn->excl_ns;
+		pn->incl_bytes = pn->excl_bytes;
+		switch(t->kind[i]) {
+		case AST_BINOP: /* FALLTHRU */
+		case AST_OUTER: /* FALLTHRU */
+		case AST_INNER: /* FALLTHRU */
+		case AST_INDEX:
+			pn->incl_ns += prof->nodes[t->arg[i]].incl_ns;
+			pn->incl_bytes += prof->nodes[t->arg[i]].incl_bytes;
+			/* FALLTHRU */
+		case AST_UNOP: /* FALLTHRU */
+		case AST_REDUCE: /* FALLTHRU */
+		case AST_ASSIGN: /* FALLTHRU */
+		case AST_SORT:
+			pn->incl_ns += prof->nodes[i - 1].incl_ns;
+			pn->incl_bytes += prof->nodes[i - 1].incl_bytes;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void ast_use_jit(int enable)
+{
+	use_jit = enable;
+}
+
+/*
+ * Runs the first n nodes as one compiled loop, without intermediate arrays.
+ * Returns NULL, for the interpreter to take over, if any node or operand
+ * can't be compiled or the integer result overflowed.
+*/
+static Value eval_jit(AST t, size_t n, const Value* args)
+{
+	struct jit_node prog[JIT_MAX_NODES];
+	uint32_t map[JIT_MAX_NODES]; /* Tree node to program node. */
+	const long* vecs[JIT_MAX_LEAVES];
+	long scalars[JIT_MAX_LEAVES];
+	size_t count = 0, nvecs = 0, nscalars = 0, len = 0, lanes;
+	jit_fn fn;
 	Value res;
-	switch(n->type) {
-	case AST_BINOP: {
-		Value left = Eval(n->left), right = Eval(n->right);
-		res = value_add(left, right);
-		value_free(left);
-		value_free(right);
-		return res;
+	if (n > JIT_MAX_NODES) {
+		return NULL;
 	}
-	case AST_UNOP:
-		return Eval(n->rest);
-	case AST_NUMBER: /* FALLTHRU */
-	case AST_VECTOR:
-		return value_reference(n->value);
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t arg = t->arg[i];
+		const long* vec = NULL;
+		size_t vlen = 0;
+		switch(t->kind[i]) {
+		case AST_BINOP:
+			if (prims[t->op[i]].jit < 0) {
+				return NULL;
+			}
+			prog[count].op = (unsigned char)prims[t->op[i]].jit;
+			prog[count].arg = map[arg];
+			map[i] = (uint32_t)count++;
+			continue;
+		case AST_UNOP:
+			if (prims[t->op[i]].monad != identity) {
+				return NULL;
+			}
+			map[i] = map[i - 1]; /* Compiles to nothing. */
+			continue;
+		case AST_OUTER: /* FALLTHRU */
+		case AST_INNER: /* FALLTHRU */
+		case AST_REDUCE: /* FALLTHRU */
+		case AST_ASSIGN: /* FALLTHRU */
+		case AST_INDEX: /* FALLTHRU */
+		case AST_SORT:
+			return NULL;
+		case AST_NUMBER:
+			if (nscalars == JIT_MAX_LEAVES) {
+				return NULL;
+			}
+			scalars[nscalars] = (long)t->pool[arg + 1];
+			prog[count].op = JIT_SCALAR;
+			prog[count].arg = (uint32_t)nscalars++;
+			map[i] = (uint32_t)count++;
+			continue;
+		case AST_VECTOR:
+			vec = (const long*)&t->pool[arg + 1];
+			vlen = t->pool[arg];
+			break;
+		case AST_ARGUMENT: /* FALLTHRU */
+		case AST_NAME: {
+			const Value v = t->kind[i] == AST_NAME ? ws_get(t->ws, arg)
+				: args ? args[arg] : NULL;
+			if (!v || value_is_float(v) || value_is_bool(v)
+					|| value_rank(v) > 1) {
+				return NULL;
+			}
+			if (value_rank(v) == 0) {
+				if (nscalars == JIT_MAX_LEAVES) {
+					return NULL;
+				}
+				scalars[nscalars] = value_scalar(v);
+				prog[count].op = JIT_SCALAR;
+				prog[count].arg = (uint32_t)nscalars++;
+				map[i] = (uint32_t)count++;
+				continue;
+			}
+			vec = value_data(v);
+			vlen = value_count(v);
+			break;
+		}
+		}
+		/* A vector leaf. All must agree in length; scalars broadcast. */
+		if (nvecs == JIT_MAX_LEAVES || (nvecs && vlen != len)) {
+			return NULL;
+		}
+		len = vlen;
+		vecs[nvecs] = vec;
+		prog[count].op = JIT_VECTOR;
+		prog[count].arg = (uint32_t)nvecs++;
+		map[i] = (uint32_t)count++;
+	}
+	if (!nvecs || !(fn = jit_kernel(prog, count, &lanes))) {
+		return NULL;
+	}
+	res = value_make_ints(len);
+	{
+		const size_t body = len - len % lanes;
+		int ovf = fn(value_data(res), vecs, scalars, body);
+		if (body < len) { /* Run the tail through padded copies. */
+			long tail_in[JIT_MAX_LEAVES][4] = { { 0 } };
+			long tail_out[4];
+			const long* tail_vecs[JIT_MAX_LEAVES];
+			assert(lanes <= 4);
+			for (size_t v = 0; v < nvecs; ++v) {
+				memcpy(tail_in[v], vecs[v] + body, (len - body) * sizeof(long));
+				tail_vecs[v] = tail_in[v];
+			}
+			ovf |= fn(tail_out, tail_vecs, scalars, lanes);
+			memcpy((long*)value_data(res) + body, tail_out,
+				(len - body) * sizeof(long));
+		}
+		if (ovf) {
+			value_free(res);
+			return NULL;
+		}
 	}
+	return res;
 }
 
-void free_node(ASTNode n)
+/*
+ * Evaluates the first n nodes, returning the value left on the stack. With
+ * prof NULL, profiling costs a predictable branch per node.
+*/
+static Value eval_nodes(AST t, size_t n, const Value* args,
+		struct Profile* prof)
 {
-	if (!n) {
-		return;
+	Value* sp;
+	if (use_jit && !prof) {
+		Value res = eval_jit(t, n, args);
+		if (res) {
+			return res;
+		}
+	}
+	if (!t->stack) {
+		t->stack = mem_alloc((t->max_depth + 1) * sizeof *t->stack);
+		assert(t->stack); /* TODO: Error handling. */
 	}
-	switch(n->type) {
-	case AST_BINOP:
-		free_node(n->left);
-		free_node(n->right);
+	sp = t->stack;
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t arg = t->arg[i];
+		uint64_t start = 0;
+		size_t bytes = 0;
+		if (prof) {
+			start = prof_now();
+			bytes = mem_allocated();
+		}
+		switch(t->kind[i]) {
+		case AST_BINOP: {
+			Value right = *--sp, left = *--sp;
+			*sp++ = prims[t->op[i]].dyad(left, right);
+			value_free(left);
+			value_free(right);
+			break;
+		}
+		case AST_OUTER: {
+			Value right = *--sp, left = *--sp;
+			*sp++ = value_outer(left, right, prims[t->op[i]].dyad);
+			value_free(left);
+			value_free(right);
+			break;
+		}
+		case AST_INNER: {
+			const struct prim* f = &prims[OP_F(t->op[i])];
+			Value right = *--sp, left = *--sp;
+			*sp++ = value_inner(left, right, f->dyad, f->reduce,
+				prims[OP_G(t->op[i])].dyad);
+			value_free(left);
+			value_free(right);
+			break;
+		}
+		case AST_INDEX: {
+			Value idx = *--sp, x = *--sp;
+			*sp++ = value_index(x, idx);
+			value_free(x);
+			value_free(idx);
+			break;
+		}
+		case AST_UNOP: {
+			Value rest = sp[-1];
+			sp[-1] = prims[t->op[i]].monad(rest);
+			value_free(rest);
+			break;
+		}
+		case AST_REDUCE: {
+			Value rest = sp[-1];
+			sp[-1] = prims[t->op[i]].reduce(rest);
+			value_free(rest);
+			break;
+		}
+		case AST_SORT: {
+			Value rest = sp[-1];
+			sp[-1] = value_sort(rest, t->op[i]);
+			value_free(rest);
+			break;
+		}
+		case AST_NUMBER:
+			*sp++ = value_make_number(t->pool[arg + 1]);
+			break;
+		case AST_VECTOR:
+			*sp++ = value_make_vector(&t->pool[arg + 1], t->pool[arg]);
+			break;
+		case AST_ARGUMENT:
+			if (!args || !args[arg]) {
+				fprintf(stdout, "Error: %s is not bound.\n", arguments[arg]);
+				exit(EXIT_FAILURE); /* TODO: Error handling */
+			}
+			*sp++ = value_reference(args[arg]);
+			break;
+		case AST_NAME:
+			if (!ws_get(t->ws, arg)) {
+				fprintf(stdout, "Error: %s is not bound.\n", ws_name(t->ws, arg));
+				exit(EXIT_FAILURE); /* TODO: Error handling */
+			}
+			*sp++ = value_reference(ws_get(t->ws, arg));
+			break;
+		case AST_ASSIGN: /* The value stays on the stack as the result. */
+			ws_set(t->ws, arg, value_reference(sp[-1]));
+			break;
+		}
+		if (prof) {
+			profile_step(prof, i, start, bytes, sp[-1]);
+		}
+	}
+	assert(sp == t->stack + 1);
+	return t->stack[0];
+}
+
+Value Eval(AST t)
+{
+	return eval_nodes(t, t->count, NULL, NULL);
+}
+
+Value EvalArgs(AST t, Value left, Value right)
+{
+	const Value args[2] = { left, right };
+	return eval_nodes(t, t->count, args, NULL);
+}
+
+Value EvalProfiled(AST t, struct Profile* prof)
+{
+	Value res;
+	assert(prof->count >= t->count);
+	res = eval_nodes(t, t->count, NULL, prof);
+	profile_inclusive(t, prof);
+	return res;
+}
+
+/* A flame graph frame naming node n, e.g. "+ stdin:0-5". No ';' allowed. */
+static void print_frame(AST t, ASTNode n, FILE* out)
+{
+	const char* name = t->in_name ? t->in_name : "?";
+	switch(t->kind[n]) {
+	case AST_BINOP: /* FALLTHRU */
+	case AST_UNOP:
+		fprintf(out, "%s", prims[t->op[n]].glyph);
+		break;
+	case AST_OUTER:
+		fprintf(out, "∘.%s", prims[t->op[n]].glyph);
+		break;
+	case AST_INNER:
+		fprintf(out, "%s.%s", prims[OP_F(t->op[n])].glyph,
+			prims[OP_G(t->op[n])].glyph);
+		break;
+	case AST_REDUCE:
+		fprintf(out, "%s/", prims[t->op[n]].glyph);
 		break;
 	case AST_NUMBER: /* FALLTHRU */
 	case AST_VECTOR:
-		value_free(n->value);
+		fprintf(out, "literal[%lu]", t->pool[t->arg[n]]);
 		break;
-	case AST_UNOP:
-		free_node(n->rest);
+	case AST_ARGUMENT:
+		fprintf(out, "%s", arguments[t->arg[n]]);
+		break;
+	case AST_NAME:
+		fprintf(out, "%s", ws_name(t->ws, t->arg[n]));
 		break;
+	case AST_ASSIGN:
+		fprintf(out, "%s←", ws_name(t->ws, t->arg[n]));
+		break;
+	case AST_INDEX:
+		fprintf(out, "[]");
+		break;
+	case AST_SORT:
+		fprintf(out, "[%s]", t->op[n] ? "⍒" : "⍋");
+		break;
+	}
+	fprintf(out, " %s:%lu-%lu", name,
+		(unsigned long)t->from[n], (unsigned long)t->to[n]);
+}
+
+/*
+ * Writes one line per node: the frames from the root down to the node, then
+ * its exclusive cost, as read by flamegraph.pl and similar tools.
+*/
+void ast_profile_folded(AST t, struct Profile* prof, enum prof_metric m,
+		FILE* out)
+{
+	uint32_t* parent = mem_alloc(t->count * sizeof *parent);
+	uint32_t* path = mem_alloc(t->count * sizeof *path);
+	assert(parent && path); /* TODO: Error handling. */
+	for (size_t i = 0; i < t->count; ++i) {
+		parent[i] = (uint32_t)t->count; /* I.e. the root. */
+	}
+	for (size_t i = 0; i < t->count; ++i) {
+		switch(t->kind[i]) {
+		case AST_BINOP: /* FALLTHRU */
+		case AST_OUTER: /* FALLTHRU */
+		case AST_INNER: /* FALLTHRU */
+		case AST_INDEX:
+			parent[t->arg[i]] = (uint32_t)i;
+			/* FALLTHRU */
+		case AST_UNOP: /* FALLTHRU */
+		case AST_REDUCE: /* FALLTHRU */
+		case AST_ASSIGN: /* FALLTHRU */
+		case AST_SORT:
+			parent[i - 1] = (uint32_t)i;
+			break;
+		default:
+			break;
+		}
+	}
+	for (size_t i = 0; i < t->count; ++i) {
+		size_t depth = 0;
+		const struct prof_node* pn = &prof->nodes[i];
+		for (uint32_t n = (uint32_t)i; n != t->count; n = parent[n]) {
+			path[depth++] = n;
+		}
+		while (depth--) {
+			print_frame(t, path[depth], out);
+			fputc(depth ? ';' : ' ', out);
+		}
+		fprintf(out, "%llu\n", (unsigned long long)(m == PROF_TIME ? pn->excl_ns
+			: m == PROF_BYTES ? pn->excl_bytes : pn->elements));
 	}
-	free(n);
+	mem_dealloc(parent);
+	mem_dealloc(path);
+}
+
+size_t ast_count(AST t)
+{
+	return t->count;
+}
+
+void ast_span(AST t, ASTNode n, size_t from, size_t to)
+{
+	t->from[n] = (uint32_t)from;
+	t->to[n] = (uint32_t)to;
+}
+
+void ast_source(AST t, const char* in_name)
+{
+	t->in_name = in_name;
+}
+
+void ast_workspace(AST t, struct Workspace* ws)
+{
+	t->ws = ws;
+}
+
+int ast_assigns(AST t)
+{
+	return memchr(t->kind, AST_ASSIGN, t->count) != NULL;
 }
 
-ASTNode make_binop(ASTNode left, char* dyad, ASTNode right)
+int ast_is_assignment(AST t)
 {
-	ASTNode n = make_node();
-	assert(n); /* TODO: Error handling. */
-	n->type = AST_BINOP;
-	n->left = left;
-	n->dyad = dyad;
-	n->right = right;
+	return t->count && t->kind[t->count - 1] == AST_ASSIGN;
+}
+
+int ast_root_reduce(AST t, Value (**reduce)(Value),
+		Value (**combine)(Value, Value))
+{
+	if (!t->count || t->kind[t->count - 1] != AST_REDUCE) {
+		return 0;
+	}
+	*reduce = prims[t->op[t->count - 1]].reduce;
+	*combine = prims[t->op[t->count - 1]].dyad;
+	return 1;
+}
+
+int ast_elementwise(AST t)
+{
+	int args = 0;
+	for (size_t i = 0; i < t->count; ++i) {
+		const unsigned char scalar = prims[OP_F(t->op[i])].scalar;
+		switch(t->kind[i]) {
+		case AST_BINOP:
+			if (!(scalar & SCALAR_DYAD)) {
+				return 0;
+			}
+			break;
+		case AST_UNOP:
+			if (!(scalar & SCALAR_MONAD)) {
+				return 0;
+			}
+			break;
+		case AST_REDUCE: /* Partial results are combined in any grouping. */
+			if (i != t->count - 1 || !(scalar & ASSOCIATIVE)) {
+				return 0;
+			}
+			break;
+		case AST_ARGUMENT:
+			args++;
+			break;
+		case AST_NUMBER:
+			break;
+		default: /* Vectors don't conform with pieces, nor names with inputs. */
+			return 0;
+		}
+	}
+	return args > 0;
+}
+
+Value EvalOperand(AST t, Value left, Value right)
+{
+	const Value args[2] = { left, right };
+	assert(t->count && t->kind[t->count - 1] == AST_REDUCE);
+	/* Post-order: the root's operand is every node before it. */
+	return eval_nodes(t, t->count - 1, args, NULL);
+}
+
+ASTNode make_binop(AST t, ASTNode left, char* dyad, ASTNode right)
+{
+	ASTNode n;
+	assert(right == t->count - 1); /* Right operand immediately precedes. */
+	n = add_node(t, AST_BINOP, lookup_form(dyad, FORM_DYAD), left, -1);
+	ast_span(t, n, t->from[left], t->to[right]);
+	return n;
+}
+
+ASTNode make_outer(AST t, ASTNode left, char* dyad, ASTNode right)
+{
+	ASTNode n;
+	assert(right == t->count - 1); /* Right operand immediately precedes. */
+	n = add_node(t, AST_OUTER, lookup_form(dyad, FORM_DYAD), left, -1);
+	ast_span(t, n, t->from[left], t->to[right]);
 	return n;
 }
 
-ASTNode make_unop(char* monad, ASTNode right)
+ASTNode make_inner(AST t, ASTNode left, char* f, char* g, ASTNode right)
 {
-	ASTNode n = make_node();
-	assert(n); /* TODO: Error handling. */
-	n->type = AST_UNOP;
-	n->monad = monad;
-	n->right = right;
+	ASTNode n;
+	uint16_t op;
+	assert(right == t->count - 1); /* Right operand immediately precedes. */
+	op = INNER_OP(lookup_form(f, FORM_REDUCE), lookup_form(g, FORM_DYAD));
+	n = add_node(t, AST_INNER, op, left, -1);
+	ast_span(t, n, t->from[left], t->to[right]);
 	return n;
 }
 
+/* Whether nodes a and b are the same name or argument. */
+static int same_leaf(AST t, ASTNode a, ASTNode b)
+{
+	return t->kind[a] == t->kind[b] && t->arg[a] == t->arg[b]
+		&& (t->kind[a] == AST_NAME || t->kind[a] == AST_ARGUMENT);
+}
+
+ASTNode make_index(AST t, ASTNode x, ASTNode idx)
+{
+	ASTNode n;
+	assert(idx == t->count - 1); /* Index immediately precedes. */
+	if (x + 2 == idx && t->kind[idx] == AST_UNOP
+			&& (prims[t->op[idx]].monad == value_grade_up
+				|| prims[t->op[idx]].monad == value_grade_down)
+			&& same_leaf(t, x, idx - 1)) {
+		/* x[⍋x]: drop the grade and its operand, and sort x directly. */
+		const unsigned char down = prims[t->op[idx]].monad == value_grade_down;
+		const uint32_t to = t->to[idx];
+		t->count -= 2;
+		t->depth -= 1;
+		n = add_node(t, AST_SORT, down, 0, 0);
+		ast_span(t, n, t->from[x], to);
+		return n;
+	}
+	n = add_node(t, AST_INDEX, 0, x, -1);
+	ast_span(t, n, t->from[x], t->to[idx]);
+	return n;
+}
+
+ASTNode make_unop(AST t, char* monad, ASTNode right)
+{
+	assert(right == t->count - 1); /* Operand immediately precedes. */
+	return add_node(t, AST_UNOP, lookup_form(monad, FORM_MONAD), 0, 0);
+}
+
+ASTNode make_reduce(AST t, char* fn, ASTNode right)
+{
+	assert(right == t->count - 1); /* Operand immediately precedes. */
+	return add_node(t, AST_REDUCE, lookup_form(fn, FORM_REDUCE), 0, 0);
+}
+
+/* A name's symbol, interned in the tree's workspace. */
+static uint32_t intern(AST t, const char* name)
+{
+	if (!t->ws) {
+		fprintf(stdout, "Error: no workspace to look up %s in.\n", name);
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	return ws_intern(t->ws, name);
+}
+
+ASTNode make_name(AST t, char* name)
+{
+	return add_node(t, AST_NAME, 0, intern(t, name), 1);
+}
+
+ASTNode make_assign(AST t, char* name, ASTNode right)
+{
+	assert(right == t->count - 1); /* Operand immediately precedes. */
+	return add_node(t, AST_ASSIGN, 0, intern(t, name), 0);
+}
+
+ASTNode make_argument(AST t, char* name)
+{
+	const uint32_t which = strcmp(name, arguments[0]) ? 1 : 0;
+	return add_node(t, AST_ARGUMENT, 0, which, 1);
+}
+
 static unsigned long parse_num(char* text)
 {
 	return strtol(text, NULL, 10);
 }
 
-ASTNode make_number(char* val)
+ASTNode make_number(AST t, char* val)
 {
-	ASTNode n = make_node();
-	assert(n); /* TODO: Error handling */
-	n->type = AST_NUMBER;
-	n->value = value_make_number(parse_num(val));
-	return n;
+	const uint32_t lit = (uint32_t)t->pool_use;
+	pool_push(t, 1);
+	pool_push(t, parse_num(val));
+	return add_node(t, AST_NUMBER, 0, lit, 1);
 }
 
-ASTNode make_vector(char* val)
+ASTNode make_vector(AST t, char* val)
 {
-	ASTNode n = make_node();
-	assert(n); /* TODO: Error handling */
-	n->type = AST_VECTOR;
-	n->value = value_make_vector(parse_num(val));
-	return n;
+	const uint32_t lit = (uint32_t)t->pool_use;
+	pool_push(t, 1);
+	pool_push(t, parse_num(val));
+	return add_node(t, AST_VECTOR, 0, lit, 1);
 }
 
-ASTNode extend_vector(ASTNode n, char* val)
+ASTNode extend_vector(AST t, ASTNode n, char* val)
 {
-	assert(n->type == AST_VECTOR);
-	n->value = value_append(n->value, parse_num(val));
+	assert(t->kind[n] == AST_VECTOR);
+	/* Vector elements are lexed together, so the vector is the last literal. */
+	assert(t->arg[n] + 1 + t->pool[t->arg[n]] == t->pool_use);
+	pool_push(t, parse_num(val));
+	t->pool[t->arg[n]]++;
 	return n;
 }
@@ -3,22 +3,91 @@
 
 #include <assert.h>			/* assert() */
 #include <errno.h>          /* errno */
+#include <stdint.h>         /* uint32_t */
 #include <stdio.h>          /* asprintf() */
 #include <string.h>         /* strerror() */
 #include "mem/mem.h"		/* mem_alloc(), mem_free() */
 #include "value/value.h"	/* Value types */
+#include "prof/prof.h"		/* struct Profile */
+#include "ws/ws.h"			/* struct Workspace */
 
-typedef struct ASTNode_* ASTNode;
+/*
+ * A whole expression tree, stored flat. Nodes live in parallel arrays in
+ * post-order (children before parents), so the root is the last node.
+*/
+typedef struct AST_* AST;
+/* Index of a node within its AST. */
+typedef uint32_t ASTNode;
 
-/* Returns a char* of the node to string, caller must free. */
-char* Stringify(ASTNode n);
-Value Eval(ASTNode n);
-void free_node(ASTNode n);
+AST ast_make(void);
+void ast_free(AST t);
+AST ast_copy(AST t);
+size_t ast_bytes(AST t); /* Memory held by t. */
 
-ASTNode make_binop(ASTNode left, char* dyad, ASTNode right);
-ASTNode make_unop(char *monad, ASTNode right);
+size_t ast_count(AST t); /* Number of nodes. */
 
-ASTNode make_number(char* val);
-ASTNode make_vector(char* val);
-ASTNode extend_vector(ASTNode vec, char* val);
+/* Hash of the normalized tree, including its literals. */
+uint64_t ast_fingerprint(AST t);
+int ast_equal(AST a, AST b);
+/*
+ * Writes ws_version() of each name t reads to versions, in node order, and
+ * returns how many there are. versions may be NULL, to count them.
+*/
+size_t ast_versions(AST t, uint64_t* versions);
+
+/* Returns a char* of the tree to string, caller must free. */
+char* Stringify(AST t);
+Value Eval(AST t);
+/* Eval() with ⍺ and ⍵ bound to left and right, either of which may be NULL. */
+Value EvalArgs(AST t, Value left, Value right);
+
+/*
+ * For evaluating in pieces. If t's root is a reduction f/x, returns nonzero
+ * and sets reduce and combine to f/ and f. EvalOperand() then evaluates x.
+*/
+int ast_root_reduce(AST t, Value (**reduce)(Value),
+		Value (**combine)(Value, Value));
+Value EvalOperand(AST t, Value left, Value right);
+/*
+ * Whether t can be evaluated in pieces: it applies scalar functions to ⍺, ⍵
+ * and numbers, with at most an associative reduction at its root.
+*/
+int ast_elementwise(AST t);
+
+/*
+ * With enable set, evaluations that are purely elementwise integer
+ * arithmetic run as fused native loops where the platform allows.
+*/
+void ast_use_jit(int enable);
+
+/* Eval(), adding each node's costs to prof (from profile_make(ast_count)). */
+Value EvalProfiled(AST t, struct Profile* prof);
+/* Writes prof's metric m in folded stack format, one line per node. */
+void ast_profile_folded(AST t, struct Profile* prof, enum prof_metric m,
+		FILE* out);
+
+/* Builders append a node, so operands must be made before their operator. */
+ASTNode make_binop(AST t, ASTNode left, char* dyad, ASTNode right);
+ASTNode make_outer(AST t, ASTNode left, char* dyad, ASTNode right); /* ∘. */
+ASTNode make_inner(AST t, ASTNode left, char* f, char* g, ASTNode right);
+ASTNode make_unop(AST t, char *monad, ASTNode right);
+ASTNode make_index(AST t, ASTNode x, ASTNode idx); /* x[idx] */
+ASTNode make_reduce(AST t, char* fn, ASTNode right);
+ASTNode make_argument(AST t, char* name);
+ASTNode make_name(AST t, char* name);
+ASTNode make_assign(AST t, char* name, ASTNode right);
+
+ASTNode make_number(AST t, char* val);
+ASTNode make_vector(AST t, char* val);
+ASTNode extend_vector(AST t, ASTNode vec, char* val);
+
+/* Records where in the input n came from. Binops get theirs automatically. */
+void ast_span(AST t, ASTNode n, size_t from, size_t to);
+void ast_source(AST t, const char* in_name);
+/* Where t's names live. Set before making any. */
+void ast_workspace(AST t, struct Workspace* ws);
+/* Whether evaluating t binds names, so it can't be skipped or repeated. */
+int ast_assigns(AST t);
+/* Whether t's root is an assignment, whose result goes unprinted. */
+int ast_is_assignment(AST t);
 #endif
@@ -7,6 +7,9 @@ struct Parser {
 	struct lexer *lex;
 	token buf[LOOKAHEAD];
 	char* input_name;
+	AST tree; /* Tree being built by the current parse(). */
+	size_t last_end; /* Input offset just past the last token taken. */
+	struct Workspace* ws; /* For names, or NULL. */
 };
 
 struct Parser* parser_make()
@@ -17,6 +20,7 @@ struct Parser* parser_make()
 	assert(p->lex); /* TODO: Error handling. */
 	p->buf_read = 0;
 	p->buf_write = 0;
+	p->ws = NULL;
 	for (size_t i = 0; i < LOOKAHEAD; ++i) {
 		p->buf[i] = (token)((char *)p + sizeof *p + token_size() * i);
 	}
@@ -67,6 +71,7 @@ static token next(struct Parser *p)
 		t = token_pop(p);
 	}
 	assert(t);
+	p->last_end = get_offset(t) + strlen(get_value(t));
 	return t;
 }
 
@@ -76,24 +81,55 @@ ASTNode Op(struct Parser *, token);
 //	expr
 //		operand
 //		operand binop expr
+//		operand ∘. binop expr
+//		operand binop . binop expr
+//		operand / expr
 ASTNode Expr(struct Parser *p, token t)
 {
 	ASTNode expr = Op(p, t);
 	switch (get_type(peek(p))) {
 	case TOKEN_EOF: /* FALLTHRU */
-	case TOKEN_RPAREN:
+	case TOKEN_RPAREN: /* FALLTHRU */
+	case TOKEN_RBRACKET:
 		return expr;
+	case TOKEN_SLASH: /* Compress, as a binop. */ /* FALLTHRU */
 	case TOKEN_OPERATOR: { /* Dyadic (binop) */
 		ASTNode res;
 		token t = next(p);
-		res = make_binop(expr, get_value(t), Expr(p, next(p)));
+		if (get_type(peek(p)) == TOKEN_DOT) { /* Inner product. */
+			token g;
+			token_free(next(p));
+			g = next(p);
+			assert(get_type(g) == TOKEN_OPERATOR); /* TODO: Error handling. */
+			res = Expr(p, next(p));
+			res = make_inner(p->tree, expr, get_value(t), get_value(g), res);
+			token_free(g);
+			token_free(t);
+			return res;
+		}
+		res = Expr(p, next(p));
+		res = make_binop(p->tree, expr, get_value(t), res);
+		token_free(t);
+		return res;
+	}
+	case TOKEN_JOT: { /* Outer product. */
+		ASTNode res;
+		token t;
+		token_free(next(p));
+		t = next(p);
+		assert(get_type(t) == TOKEN_DOT); /* TODO: Error handling. */
+		token_free(t);
+		t = next(p);
+		assert(get_type(t) == TOKEN_OPERATOR); /* TODO: Error handling. */
+		res = Expr(p, next(p));
+		res = make_outer(p->tree, expr, get_value(t), res);
 		token_free(t);
 		return res;
 	}
 	default:
 		printf("DEBUG: %s\n", get_value(peek(p)));
 		assert(0); /* TODO: Error handling */
-		return NULL;
+		return 0;
 	}
 }
 
@@ -102,15 +138,15 @@ ASTNode NumberOrVector(struct Parser *p, token t)
 {
 	ASTNode res;
 	if (get_type(peek(p)) != TOKEN_NUMBER) {
-		res = make_number(get_value(t));
+		res = make_number(p->tree, get_value(t));
 		token_free(t);
 		return res;
 	}
-	res = make_vector(get_value(t));
+	res = make_vector(p->tree, get_value(t));
 	token_free(t);
 	while (get_type(peek(p)) == TOKEN_NUMBER) {
 		t = next(p);
-		res = extend_vector(res, get_value(t));
+		res = extend_vector(p->tree, res, get_value(t));
 		token_free(t);
 	}
 	return res;
@@ -122,10 +158,16 @@ ASTNode NumberOrVector(struct Parser *p, token t)
 //		( Expr ) [ Expr ]...
 //		operand
 //		number
+//		argument
+//		name
+//		name ← Expr
 //		unop Expr
+//		unop / Expr
+//		operand [ Expr ]...
 ASTNode Op(struct Parser *p, token t)
 {
 	ASTNode op;
+	const size_t from = get_offset(t);
 	switch(get_type(t)) {
 	case TOKEN_LPAREN:
 		op = Expr(p, next(p));
@@ -137,25 +179,67 @@ ASTNode Op(struct Parser *p, token t)
 	case TOKEN_NUMBER:
 		op = NumberOrVector(p, t);
 		break;
+	case TOKEN_ARGUMENT:
+		op = make_argument(p->tree, get_value(t));
+		token_free(t);
+		break;
+	case TOKEN_NAME:
+		if (get_type(peek(p)) == TOKEN_ASSIGN) {
+			token_free(next(p));
+			op = Expr(p, next(p));
+			op = make_assign(p->tree, get_value(t), op);
+		} else {
+			op = make_name(p->tree, get_value(t));
+		}
+		token_free(t);
+		break;
 	case TOKEN_OPERATOR:
-		op = make_unop(get_value(t), Expr(p, next(p)));
+		if (get_type(peek(p)) == TOKEN_SLASH) { /* Reduction. */
+			token_free(next(p));
+			op = Expr(p, next(p));
+			op = make_reduce(p->tree, get_value(t), op);
+		} else {
+			op = Expr(p, next(p));
+			op = make_unop(p->tree, get_value(t), op);
+		}
 		token_free(t);
 		break;
 	default:
 		printf("DEBUG: %s\n", get_value(t));
 		token_free(t);
 		assert(0); /* TODO: Error handling */
-		return NULL;
+		return 0;
 	};
-	return op; /* TODO: Indexing. */
+	while (get_type(peek(p)) == TOKEN_LBRACKET) {
+		ASTNode idx;
+		token_free(next(p));
+		idx = Expr(p, next(p));
+		t = next(p);
+		assert(get_type(t) == TOKEN_RBRACKET); /* TODO: Error handling. */
+		token_free(t);
+		op = make_index(p->tree, op, idx);
+	}
+	ast_span(p->tree, op, from, p->last_end);
+	return op;
+}
+
+void parser_workspace(struct Parser* p, struct Workspace* ws)
+{
+	p->ws = ws;
 }
 
-ASTNode parse(struct Parser* p, char* in, char* in_name)
+/* Returns a new tree, which the caller frees with ast_free(). */
+AST parse(struct Parser* p, char* in, char* in_name)
 {
 	assert(p);
 	assert(in);
 
 	lexer_init(p->lex, in, in_name);
+	p->buf_read = p->buf_write = 0; /* Drop the last parse's lookahead. */
 	p->input_name = in_name;
-	return Expr(p, next(p));
+	p->tree = ast_make();
+	ast_source(p->tree, in_name);
+	ast_workspace(p->tree, p->ws);
+	Expr(p, next(p));
+	return p->tree;
 }
@@ -10,5 +10,7 @@
 #include "ASTNode.h"		/* ASTNode definitions */
 
 struct Parser* parser_make();
-ASTNode parse(struct Parser *p, char* in, char* in_name);
+AST parse(struct Parser *p, char* in, char* in_name);
 void parser_free(struct Parser *p);
+/* Names in later parses are interned in ws, which outlives their trees. */
+void parser_workspace(struct Parser *p, struct Workspace* ws);
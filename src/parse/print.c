@@ -22,6 +22,30 @@ static void print_token(token t, FILE* out)
 	case TOKEN_RPAREN:
 		name = "Close parenthesis";
 		break;
+	case TOKEN_ARGUMENT:
+		name = "argument";
+		break;
+	case TOKEN_SLASH:
+		name = "slash";
+		break;
+	case TOKEN_NAME:
+		name = "name";
+		break;
+	case TOKEN_ASSIGN:
+		name = "assign";
+		break;
+	case TOKEN_LBRACKET:
+		name = "Open bracket";
+		break;
+	case TOKEN_RBRACKET:
+		name = "Close bracket";
+		break;
+	case TOKEN_JOT:
+		name = "jot";
+		break;
+	case TOKEN_DOT:
+		name = "dot";
+		break;
 	};
 	fprintf(out, "Found %s : %s\n", name, get_value(t));
 }
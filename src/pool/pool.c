@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L /* pthreads, sysconf() */
+#include <pthread.h>		/* pthread_create(), pthread_cond_wait() */
+#include <unistd.h>			/* sysconf() */
+#include "pool.h"
+
+static size_t nthreads; /* 0 until started or set. */
+
+#ifndef __EMSCRIPTEN__
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER; /* A run's turn. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* Guards job. */
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER; /* A run began. */
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER; /* Its last task ended. */
+
+/* The current run. Tasks are taken in order, by whichever thread is free. */
+static struct {
+	void (*fn)(void* arg, size_t i);
+	void* arg;
+	size_t n;
+	size_t next; /* Next task to take. */
+	size_t done;
+	size_t allocated; /* By tasks on other threads than the caller's. */
+	unsigned long gen; /* Counts runs, so workers can tell a new one. */
+} job;
+
+static _Thread_local int in_task;
+
+/*
+ * Takes and runs tasks until none are left. Called, and returns, locked.
+ * The caller's allocations count already; a worker's are added to the run's.
+*/
+static void take_tasks(int caller)
+{
+	in_task = 1;
+	while (job.next < job.n) {
+		void (*fn)(void*, size_t) = job.fn;
+		void* arg = job.arg;
+		const size_t i = job.next++;
+		const size_t before = caller ? 0 : mem_allocated();
+		pthread_mutex_unlock(&lock);
+		fn(arg, i);
+		pthread_mutex_lock(&lock);
+		if (!caller) {
+			job.allocated += mem_allocated() - before;
+		}
+		if (++job.done == job.n) {
+			pthread_cond_signal(&idle);
+		}
+	}
+	in_task = 0;
+}
+
+static void* worker(void* unused)
+{
+	unsigned long seen = 0;
+	(void)unused;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (job.gen == seen) {
+			pthread_cond_wait(&work, &lock);
+		}
+		seen = job.gen;
+		take_tasks(0);
+	}
+	return NULL;
+}
+
+static void start(void)
+{
+	if (!nthreads) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = cpus > 0 ? (size_t)cpus : 1;
+	}
+	for (size_t i = 1; i < nthreads; ++i) { /* The caller is the first. */
+		pthread_t t;
+		if (pthread_create(&t, NULL, worker, NULL)) {
+			nthreads = i; /* TODO: Error handling. Make do with fewer. */
+			break;
+		}
+		pthread_detach(t);
+	}
+}
+#endif
+
+void pool_init(size_t threads)
+{
+	nthreads = threads;
+}
+
+size_t pool_threads(void)
+{
+#ifdef __EMSCRIPTEN__
+	return 1;
+#else
+	pthread_once(&started, start);
+	return nthreads;
+#endif
+}
+
+void pool_run(size_t n, void (*fn)(void* arg, size_t i), void* arg)
+{
+#ifndef __EMSCRIPTEN__
+	if (pool_threads() > 1 && n > 1 && !in_task) {
+		size_t allocated;
+		pthread_mutex_lock(&run_lock);
+		pthread_mutex_lock(&lock);
+		job.fn = fn;
+		job.arg = arg;
+		job.n = n;
+		job.next = 0;
+		job.done = 0;
+		job.allocated = 0;
+		job.gen++;
+		pthread_cond_broadcast(&work);
+		take_tasks(1);
+		while (job.done < job.n) {
+			pthread_cond_wait(&idle, &lock);
+		}
+		allocated = job.allocated;
+		pthread_mutex_unlock(&lock);
+		pthread_mutex_unlock(&run_lock);
+		mem_credit(allocated);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < n; ++i) {
+		fn(arg, i);
+	}
+}
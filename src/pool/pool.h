@@ -0,0 +1,28 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <assert.h>		/* assert() */
+#include <stddef.h>		/* size_t */
+#include "mem/mem.h"	/* mem_alloc(), mem_dealloc() */
+
+/*
+ * A fixed set of worker threads for data parallel kernels. Work is given as
+ * a count of independent tasks, which the workers and the caller take in
+ * turn until all are done. Under emcc, or with one thread, tasks run on the
+ * caller, in order.
+*/
+
+/*
+ * Sets the number of threads, including the caller's, before first use.
+ * Otherwise the pool starts with one per online CPU.
+*/
+void pool_init(size_t threads);
+size_t pool_threads(void);
+
+/*
+ * Runs fn(arg, i) for each i in [0, n) and returns when all have finished.
+ * Runs from different threads take turns, and a run from inside a task
+ * happens inline, on the task's thread.
+*/
+void pool_run(size_t n, void (*fn)(void* arg, size_t i), void* arg);
+#endif
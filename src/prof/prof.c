@@ -0,0 +1,24 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+#include <time.h>	/* clock_gettime() */
+#include "prof.h"
+
+struct Profile* profile_make(size_t nodes)
+{
+	struct Profile* p = mem_alloc(sizeof *p + nodes * sizeof p->nodes[0]);
+	assert(p); /* TODO: Error handling */
+	memset(p, 0, sizeof *p + nodes * sizeof p->nodes[0]);
+	p->count = nodes;
+	return p;
+}
+
+void profile_free(struct Profile* p)
+{
+	mem_dealloc(p);
+}
+
+uint64_t prof_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
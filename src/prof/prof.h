@@ -0,0 +1,31 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <assert.h>		/* assert() */
+#include <stdint.h>		/* uint64_t */
+#include <string.h>		/* memset() */
+#include "mem/mem.h"	/* mem_alloc(), mem_allocated() */
+
+/* What one AST node cost, summed over every evaluation profiled. */
+struct prof_node {
+	uint64_t calls;
+	uint64_t incl_ns; /* Including the node's operands. */
+	uint64_t excl_ns; /* The node alone. */
+	uint64_t incl_bytes; /* Allocated, as counted by mem_allocated(). */
+	uint64_t excl_bytes;
+	uint64_t elements; /* In the node's results. */
+};
+
+enum prof_metric { PROF_TIME, PROF_BYTES, PROF_ELEMENTS };
+
+struct Profile {
+	size_t count;
+	struct prof_node nodes[];
+};
+
+struct Profile* profile_make(size_t nodes);
+void profile_free(struct Profile* p);
+
+/* Monotonic nanoseconds. */
+uint64_t prof_now(void);
+#endif
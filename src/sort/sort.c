@@ -0,0 +1,172 @@
+#include "sort.h"
+
+#define SMALL_SORT 64 /* Inputs up to this size are insertion sorted. */
+#define PARALLEL_MIN (1 << 16) /* Smaller inputs aren't split. */
+#define DIGIT_BITS 8
+#define RADIX (1 << DIGIT_BITS)
+#define MAX_PARTS 64
+
+/* One pass, over parts slices of the input, one per task. */
+struct pass {
+	const unsigned long* keys;
+	const unsigned long* pay;
+	unsigned long* keys_out;
+	unsigned long* pay_out;
+	size_t n;
+	size_t parts;
+	unsigned shift;
+	size_t (*counts)[RADIX]; /* Each part's histogram, then its offsets. */
+	unsigned long* lo; /* Each part's smallest and largest key. */
+	unsigned long* hi;
+};
+
+static size_t part_start(const struct pass* ps, size_t p)
+{
+	return ps->n / ps->parts * p + (p < ps->n % ps->parts ? p : ps->n % ps->parts);
+}
+
+static void range_part(void* arg, size_t p)
+{
+	struct pass* ps = arg;
+	const size_t end = part_start(ps, p + 1);
+	unsigned long lo = ~0UL, hi = 0;
+	for (size_t i = part_start(ps, p); i < end; ++i) {
+		lo = ps->keys[i] < lo ? ps->keys[i] : lo;
+		hi = ps->keys[i] > hi ? ps->keys[i] : hi;
+	}
+	ps->lo[p] = lo;
+	ps->hi[p] = hi;
+}
+
+static void count_part(void* arg, size_t p)
+{
+	struct pass* ps = arg;
+	size_t* counts = ps->counts[p];
+	const size_t end = part_start(ps, p + 1);
+	memset(counts, 0, sizeof ps->counts[p]);
+	for (size_t i = part_start(ps, p); i < end; ++i) {
+		counts[ps->keys[i] >> ps->shift & (RADIX - 1)]++;
+	}
+}
+
+static void scatter_part(void* arg, size_t p)
+{
+	struct pass* ps = arg;
+	size_t* offsets = ps->counts[p];
+	const size_t end = part_start(ps, p + 1);
+	for (size_t i = part_start(ps, p); i < end; ++i) {
+		const size_t o = offsets[ps->keys[i] >> ps->shift & (RADIX - 1)]++;
+		ps->keys_out[o] = ps->keys[i];
+		if (ps->pay) {
+			ps->pay_out[o] = ps->pay[i];
+		}
+	}
+}
+
+static void insertion_sort(unsigned long* keys, unsigned long* pay, size_t n)
+{
+	for (size_t i = 1; i < n; ++i) {
+		const unsigned long k = keys[i];
+		const unsigned long v = pay ? pay[i] : 0;
+		size_t j = i;
+		for (; j > 0 && keys[j - 1] > k; --j) { /* Strictly, so it's stable. */
+			keys[j] = keys[j - 1];
+			if (pay) {
+				pay[j] = pay[j - 1];
+			}
+		}
+		keys[j] = k;
+		if (pay) {
+			pay[j] = v;
+		}
+	}
+}
+
+/* Whether one digit value holds every key, so the pass would change nothing. */
+static int one_digit(struct pass* ps)
+{
+	for (size_t d = 0; d < RADIX; ++d) {
+		size_t total = 0;
+		for (size_t p = 0; p < ps->parts; ++p) {
+			total += ps->counts[p][d];
+		}
+		if (total) {
+			return total == ps->n;
+		}
+	}
+	return 1;
+}
+
+/* Turns histograms into each part's first output slot for each digit. */
+static void offsets(struct pass* ps)
+{
+	size_t at = 0;
+	for (size_t d = 0; d < RADIX; ++d) {
+		for (size_t p = 0; p < ps->parts; ++p) {
+			const size_t c = ps->counts[p][d];
+			ps->counts[p][d] = at;
+			at += c;
+		}
+	}
+}
+
+void sort_keys(unsigned long* keys, unsigned long* payload, size_t n)
+{
+	struct pass ps;
+	unsigned long lo = ~0UL, hi = 0, differ;
+	unsigned long* tmp;
+	unsigned bits = 0;
+	if (n <= SMALL_SORT) {
+		insertion_sort(keys, payload, n);
+		return;
+	}
+	ps.n = n;
+	ps.parts = n < PARALLEL_MIN ? 1 : pool_threads();
+	ps.parts = ps.parts > MAX_PARTS ? MAX_PARTS : ps.parts;
+	ps.counts = mem_alloc(sizeof *ps.counts * ps.parts);
+	ps.lo = mem_alloc(sizeof *ps.lo * ps.parts * 2);
+	assert(ps.counts && ps.lo); /* TODO: Error handling */
+	ps.hi = ps.lo + ps.parts;
+	ps.keys = keys;
+
+	/* Keys in [lo, hi] share every bit above the highest where lo and hi
+	 * differ, so only the bits below it need sorting. */
+	pool_run(ps.parts, range_part, &ps);
+	for (size_t p = 0; p < ps.parts; ++p) {
+		lo = ps.lo[p] < lo ? ps.lo[p] : lo;
+		hi = ps.hi[p] > hi ? ps.hi[p] : hi;
+	}
+	for (differ = lo ^ hi; differ; differ >>= 1) {
+		bits++;
+	}
+
+	tmp = mem_alloc(sizeof *tmp * n * (payload ? 2 : 1));
+	assert(tmp); /* TODO: Error handling */
+	ps.pay = payload;
+	ps.keys_out = tmp;
+	ps.pay_out = payload ? tmp + n : NULL;
+	for (ps.shift = 0; ps.shift < bits; ps.shift += DIGIT_BITS) {
+		pool_run(ps.parts, count_part, &ps);
+		if (one_digit(&ps)) {
+			continue;
+		}
+		offsets(&ps);
+		pool_run(ps.parts, scatter_part, &ps);
+		{ /* The output is the next pass's input. */
+			const unsigned long* k = ps.keys, *v = ps.pay;
+			ps.keys = ps.keys_out;
+			ps.pay = ps.pay_out;
+			ps.keys_out = (unsigned long*)k;
+			ps.pay_out = (unsigned long*)v;
+		}
+	}
+	if (ps.keys != keys) { /* An odd number of passes ended in tmp. */
+		memcpy(keys, ps.keys, sizeof *keys * n);
+		if (payload) {
+			memcpy(payload, ps.pay, sizeof *payload * n);
+		}
+	}
+	mem_dealloc(tmp);
+	mem_dealloc(ps.lo);
+	mem_dealloc(ps.counts);
+}
@@ -0,0 +1,19 @@
+#ifndef SORT_H_
+#define SORT_H_
+
+#include <assert.h>		/* assert() */
+#include <stddef.h>		/* size_t */
+#include <string.h>		/* memcpy() */
+#include "mem/mem.h"	/* mem_alloc(), mem_dealloc() */
+#include "pool/pool.h"	/* pool_run() */
+
+/*
+ * Sorts n unsigned keys ascending, stably, moving payload (if not NULL)
+ * along with them. Large inputs get an LSD radix sort a byte per pass. Only
+ * the bits that differ between the smallest and largest keys are sorted on,
+ * and bytes every key shares are skipped, so narrow ranges take few passes.
+ * Each pass is split across the thread pool. Small inputs use insertion
+ * sort.
+*/
+void sort_keys(unsigned long* keys, unsigned long* payload, size_t n);
+#endif
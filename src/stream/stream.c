@@ -0,0 +1,242 @@
+#define _POSIX_C_SOURCE 200809L /* pthreads, read() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
+#include <pthread.h>		/* pthread_create(), pthread_cond_wait() */
+#include <stdlib.h>			/* exit() */
+#include <string.h>			/* strerror() */
+#include <sys/stat.h>		/* fstat() */
+#include <unistd.h>			/* read(), close() */
+#include "stream.h"
+
+/* A file read ahead into a ring of chunks by its own thread. */
+struct Source {
+	int fd;
+	size_t chunk;
+	size_t length; /* In elements, or SIZE_MAX if not a regular file. */
+	pthread_t reader;
+	pthread_mutex_t lock;
+	pthread_cond_t changed; /* A chunk was queued or taken, or done/stop. */
+	Value ring[STREAM_DEPTH];
+	size_t head;
+	size_t count;
+	int done; /* Reader reached the end of the file. */
+	int stop; /* Consumer is closing the source. */
+};
+
+/* Reads up to len bytes, stopping short only at the end of the file. */
+static size_t read_full(int fd, char* buf, size_t len)
+{
+	size_t got = 0;
+	while (got < len) {
+		const ssize_t n = read(fd, buf + got, len - got);
+		if (n == 0) {
+			break;
+		}
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "error reading: %s\n", strerror(errno));
+			break; /* TODO: Error handling. Treated as end of file. */
+		}
+		got += n;
+	}
+	return got;
+}
+
+static void* read_ahead(void* arg)
+{
+	struct Source* s = arg;
+	for (;;) {
+		Value v;
+		size_t bytes;
+		int done;
+		pthread_mutex_lock(&s->lock);
+		while (s->count == STREAM_DEPTH && !s->stop) {
+			pthread_cond_wait(&s->changed, &s->lock);
+		}
+		if (s->stop) {
+			pthread_mutex_unlock(&s->lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&s->lock);
+
+		/* Read straight into the chunk's Value, outside the lock. */
+		v = value_make_ints(s->chunk);
+		bytes = read_full(s->fd, value_data(v), s->chunk * sizeof(long));
+		value_truncate(v, bytes / sizeof(long));
+
+		pthread_mutex_lock(&s->lock);
+		if (value_count(v)) {
+			s->ring[(s->head + s->count++) % STREAM_DEPTH] = v;
+		} else {
+			value_free(v);
+		}
+		/* A short read means the end of the file. */
+		s->done = bytes < s->chunk * sizeof(long);
+		done = s->done;
+		pthread_cond_broadcast(&s->changed);
+		pthread_mutex_unlock(&s->lock);
+		if (done) {
+			return NULL;
+		}
+	}
+}
+
+struct Source* source_open(const char* path, size_t chunk)
+{
+	struct Source* s;
+	struct stat st;
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st)) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	s = mem_alloc(sizeof *s);
+	assert(s); /* TODO: Error handling */
+	memset(s, 0, sizeof *s);
+	s->fd = fd;
+	s->chunk = chunk;
+	s->length = S_ISREG(st.st_mode) ? (size_t)st.st_size / sizeof(long)
+		: SIZE_MAX;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->changed, NULL);
+	if (pthread_create(&s->reader, NULL, read_ahead, s)) {
+		assert(0); /* TODO: Error handling */
+	}
+	return s;
+}
+
+/* Returns the next chunk, or NULL at the end of the file. */
+static Value source_next(struct Source* s)
+{
+	Value v = NULL;
+	pthread_mutex_lock(&s->lock);
+	while (s->count == 0 && !s->done) {
+		pthread_cond_wait(&s->changed, &s->lock);
+	}
+	if (s->count) {
+		v = s->ring[s->head];
+		s->head = (s->head + 1) % STREAM_DEPTH;
+		s->count--;
+		pthread_cond_broadcast(&s->changed);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return v;
+}
+
+void source_close(struct Source* s)
+{
+	if (!s) {
+		return;
+	}
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->changed);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->reader, NULL);
+	for (; s->count; s->count--, s->head = (s->head + 1) % STREAM_DEPTH) {
+		value_free(s->ring[s->head]);
+	}
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->changed);
+	close(s->fd);
+	mem_dealloc(s);
+}
+
+void sink_text(struct Sink* s, Value chunk)
+{
+	char* str = value_stringify(chunk);
+	fprintf(s->out, s->written ? " %s" : "%s", str);
+	mem_dealloc(str);
+	s->written += value_count(chunk);
+}
+
+void sink_binary(struct Sink* s, Value chunk)
+{
+	Value ints;
+	if (value_is_float(chunk)) {
+		fprintf(stdout, "Error: result overflowed, can't write as integers.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	ints = value_widen(chunk); /* Booleans are written as longs too. */
+	if (fwrite(value_data(ints), sizeof(long), value_count(ints), s->out)
+			!= value_count(ints)) {
+		fprintf(stderr, "error writing: %s\n", strerror(errno));
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	s->written += value_count(ints);
+	value_free(ints);
+}
+
+Value stream_eval(AST t, struct Source* left, struct Source* right,
+		struct Sink* out)
+{
+	Value (*reduce)(Value) = NULL;
+	Value (*combine)(Value, Value) = NULL;
+	const int reducing = ast_root_reduce(t, &reduce, &combine);
+	Value total = NULL;
+	assert(left || right);
+	/* Checked before any output, which can't be taken back. */
+	if (!ast_elementwise(t)) {
+		fprintf(stdout, "Error: only scalar functions of ⍺ and ⍵, and a "
+			"reduction of them, can be streamed.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	if (left && right) {
+		if (left->length == SIZE_MAX || right->length == SIZE_MAX) {
+			fprintf(stdout, "Error: ⍺ and ⍵ must be regular files, so their "
+				"lengths can be checked.\n");
+			exit(EXIT_FAILURE); /* TODO: Error handling */
+		}
+		if (left->length != right->length) {
+			fprintf(stdout, "Error: mismatched shapes.\n");
+			exit(EXIT_FAILURE); /* TODO: Error handling */
+		}
+	}
+	for (;;) {
+		Value l = left ? source_next(left) : NULL;
+		Value r = right ? source_next(right) : NULL;
+		if ((left && !l) || (right && !r)) {
+			if (l || r) { /* A file changed length while it was read. */
+				fprintf(stdout, "Error: mismatched shapes.\n");
+				exit(EXIT_FAILURE); /* TODO: Error handling */
+			}
+			break;
+		}
+		if (reducing) {
+			Value x = EvalOperand(t, l, r);
+			Value part = reduce(x);
+			value_free(x);
+			if (total) {
+				Value sum = combine(total, part);
+				value_free(total);
+				value_free(part);
+				total = sum;
+			} else {
+				total = part;
+			}
+		} else {
+			Value res = EvalArgs(t, l, r);
+			out->write(out, res);
+			value_free(res);
+		}
+		if (l) {
+			value_free(l);
+		}
+		if (r) {
+			value_free(r);
+		}
+	}
+	if (reducing && !total) { /* Empty input: reduce an empty vector. */
+		Value empty = value_make_ints(0);
+		total = reduce(empty);
+		value_free(empty);
+	}
+	return total;
+}
@@ -0,0 +1,51 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <assert.h>			/* assert() */
+#include <stdio.h>			/* FILE* */
+#include "mem/mem.h"		/* mem_alloc(), mem_dealloc() */
+#include "value/value.h"	/* Value types */
+#include "parse/ASTNode.h"	/* AST, EvalArgs() */
+
+/*
+ * Evaluates expressions over arrays too large for memory. Inputs are files of
+ * native longs, bound to ⍺ and ⍵ and read a chunk at a time by a thread that
+ * stays STREAM_DEPTH chunks ahead, so reading overlaps with evaluation.
+*/
+#define STREAM_DEPTH 2
+
+struct Source;
+
+/*
+ * chunk is in elements. Returns NULL, with errno set, if path can't open.
+ * Pipes and the like can be read, but only as the sole source.
+*/
+struct Source* source_open(const char* path, size_t chunk);
+void source_close(struct Source* s);
+
+/* Where the chunks of an elementwise result go, in order. */
+struct Sink {
+	void (*write)(struct Sink* s, Value chunk);
+	FILE* out;
+	size_t written; /* Elements written so far. */
+};
+
+/* Prints elements as text, space separated. */
+void sink_text(struct Sink* s, Value chunk);
+/* Writes elements as native longs. */
+void sink_binary(struct Sink* s, Value chunk);
+
+/*
+ * Evaluates t a chunk at a time with ⍺ and ⍵ read from left and right
+ * (either may be NULL). Elementwise results are written to out, and NULL is
+ * returned. If t is a reduction f/x, x is evaluated a chunk at a time, the
+ * partial results are combined with f, and the total is returned. t must
+ * pass ast_elementwise(), and ⍺ and ⍵ must be the same length; both are
+ * checked before anything is written.
+ * Each source holds up to STREAM_DEPTH chunks queued or being read, and one
+ * being evaluated, so inputs take chunk * (STREAM_DEPTH + 1) longs each.
+ * Evaluation adds a chunk per intermediate result the expression holds.
+*/
+Value stream_eval(AST t, struct Source* left, struct Source* right,
+		struct Sink* out);
+#endif
@@ -5,6 +5,7 @@
 
 struct token_ {
 	enum token_type type;
+	size_t offset; /* Of the token's first byte in the lexer's input. */
 	size_t size;
 	char value[MAX_SIZE];
 };
@@ -40,13 +41,15 @@ fail_mem_alloc_token:
 	return NULL;
 }
 
-token token_make(enum token_type type, const char* s, size_t slen, token prev)
+token token_make(enum token_type type, const char* s, size_t slen,
+		size_t offset, token prev)
 {
 	token t;
 	assert(slen < MAX_SIZE); /* TODO: Error handling. */
 	t = alloc_token(prev);
 	if (!t) goto fail_alloc_token;
 	t->type = type;
+	t->offset = offset;
 	t->size = slen;
 	memcpy(t->value, s, slen + 1);
 	assert_valid_token(t);
@@ -72,6 +75,12 @@ enum token_type get_type(token t)
 	return t->type;
 }
 
+size_t get_offset(token t)
+{
+	assert_valid_token(t);
+	return t->offset;
+}
+
 char* get_value(token t)
 {
 	assert_valid_token(t);
@@ -13,16 +13,26 @@ enum token_type {
 	TOKEN_NUMBER,
 	TOKEN_OPERATOR,
 	TOKEN_LPAREN,
-	TOKEN_RPAREN
+	TOKEN_RPAREN,
+	TOKEN_ARGUMENT, /* ⍺ or ⍵ */
+	TOKEN_SLASH,
+	TOKEN_NAME,
+	TOKEN_ASSIGN, /* ← */
+	TOKEN_LBRACKET,
+	TOKEN_RBRACKET,
+	TOKEN_JOT, /* ∘ */
+	TOKEN_DOT
 };
 
 typedef struct token_* token;
 
-/* slen = strlen(s) */
-token token_make(enum token_type type, const char* s, size_t slen, token prev);
+/* slen = strlen(s), offset is where the token starts in the input. */
+token token_make(enum token_type type, const char* s, size_t slen,
+		size_t offset, token prev);
 void token_free(token);
 token token_copy(token dst, token src);
 char* get_value(token);
+size_t get_offset(token);
 enum token_type get_type(token);
 size_t token_size();
 #endif
@@ -1,20 +1,175 @@
 #include "value.h"
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+#include <immintrin.h>	/* _mm256_i64gather_epi64() */
+#endif
+
 struct Value_ {
 	size_t refcount;
-	enum type { INTEGER, VECTOR } type; /* TODO: Add other types. */
+	enum type { INTEGER, VECTOR, FLOAT, BOOLEAN } type; /* TODO: Add other types. */
 	union {
 		struct { /* Vector */
 			/* Inspired by Roger Hui's An Implementation of J */
-			enum type vec_type; /* TODO: Add other types. */
+			enum type vec_type; /* INTEGER, FLOAT or BOOLEAN. */
 			size_t ecount; /* Number of elements used. */
 			size_t acount; /* Number of elements allocated. */
 			unsigned long rank;
+			/* A view shares the elements of base (never itself */
+			/* a view), starting at offset. */
+			Value base; /* NULL unless a view. */
+			size_t offset;
 			unsigned long sd[1]; /* Shape & Data array. */
 			/* Preallocated for singleton case. (Data: 1 value). */
+			/* Data begins at sd[rank], and is laid out by vec_type. */
+			/* Booleans are packed a word at a time, low bit first, */
+			/* and the bits past ecount in the last word are zero. */
 		};
 	};
 };
 
+/*
+ * Every element is a word: data_of() counts in words whatever the type,
+ * integers widen to doubles in place, and doubles are sorted and hashed as
+ * their bits. Hence LP64 only, and the web build is wasm64.
+*/
+_Static_assert(sizeof(long) == sizeof(double), "Elements are a word.");
+
+/* Elements are processed in blocks this size when checking for overflow. */
+#define BLOCK 256
+
+#define WORD_BITS (CHAR_BIT * sizeof(unsigned long))
+
+/* Refcount of Values stored in a mapped image, which are never freed. */
+#define PINNED SIZE_MAX
+
+/* Smallest selection worth making a view of, rather than copying. */
+#define VIEW_MIN 64
+
+/* Where v's elements are: after its shape, or in its base for a view. */
+static unsigned long* data_of(Value v)
+{
+	if (!v->base) {
+		return &v->sd[v->rank];
+	}
+	return &v->base->sd[v->base->rank] + v->offset;
+}
+
+/* Words holding n booleans. */
+static size_t words(size_t n)
+{
+	return (n + WORD_BITS - 1) / WORD_BITS;
+}
+
+static long* ints(Value v)
+{
+	return (long *)data_of(v);
+}
+
+static double* floats(Value v)
+{
+	return (double *)data_of(v);
+}
+
+static unsigned long* bits(Value v)
+{
+	return data_of(v);
+}
+
+static unsigned long get_bit(Value v, size_t i)
+{
+	return bits(v)[i / WORD_BITS] >> (i % WORD_BITS) & 1;
+}
+
+/* The low n bits of a word set, for 0 < n <= WORD_BITS. */
+static unsigned long low_mask(size_t n)
+{
+	return n == WORD_BITS ? ~0UL : (1UL << n) - 1;
+}
+
+/* Zeroes the bits past the last element, after a whole word operation. */
+static void clear_tail(Value v)
+{
+	if (v->ecount % WORD_BITS) {
+		bits(v)[v->ecount / WORD_BITS] &= low_mask(v->ecount % WORD_BITS);
+	}
+}
+
+/* Bytes needed to hold the shape and ecount elements of the given type. */
+static size_t data_size(enum type t, unsigned long rank, size_t ecount)
+{
+	const size_t elem = t == FLOAT ? sizeof(double) : sizeof(long);
+	if (t == BOOLEAN) {
+		return sizeof(unsigned long) * (rank + words(ecount));
+	}
+	return sizeof(unsigned long) * rank + elem * ecount;
+}
+
+/* Creates an uninitialized Value of the given shape. */
+static Value make_value(enum type t, unsigned long rank,
+		const unsigned long* shape, size_t ecount)
+{
+	Value v = mem_alloc(sizeof *v + data_size(t, rank, ecount));
+	assert(v); /* TODO: Error handling */
+	v->refcount = 1;
+	v->type = rank ? VECTOR : INTEGER;
+	v->rank = rank;
+	v->ecount = ecount;
+	v->acount = ecount;
+	v->vec_type = t;
+	v->base = NULL;
+	v->offset = 0;
+	if (shape) {
+		memcpy(&v->sd[0], shape, sizeof v->sd[0] * rank);
+	}
+	if (t == BOOLEAN) { /* Zeroed, so kernels can set bits by or-ing. */
+		memset(bits(v), 0, sizeof(unsigned long) * words(ecount));
+	}
+	return v;
+}
+
+/*
+ * Small integer scalars are immediates, held in the handle itself rather
+ * than allocated: the number shifted up a bit, with the low bit set, which
+ * an allocated Value's address never has. Entry points read them through a
+ * rank 0 Value on the stack, so the code below them needn't know.
+*/
+_Static_assert(sizeof(long) == sizeof(uintptr_t), "An immediate is a long.");
+#define IMMEDIATE(v) ((uintptr_t)(v) & 1)
+#define IMMEDIATE_MAX (LONG_MAX / 2)
+#define IMMEDIATE_MIN (LONG_MIN / 2)
+
+static int fits_immediate(long n)
+{
+	return n >= IMMEDIATE_MIN && n <= IMMEDIATE_MAX;
+}
+
+static Value immediate(long n)
+{
+	return (Value)((uintptr_t)n << 1 | 1);
+}
+
+static long immediate_value(Value v)
+{
+	return (long)(intptr_t)v >> 1; /* Arithmetic, so the sign is kept. */
+}
+
+/* v, or if it's an immediate, the same number filled in to box. */
+static Value unbox(Value v, struct Value_* box)
+{
+	if (!IMMEDIATE(v)) {
+		return v;
+	}
+	box->refcount = PINNED; /* Neither freed nor kept past the call. */
+	box->type = INTEGER;
+	box->vec_type = INTEGER;
+	box->rank = 0;
+	box->ecount = 1;
+	box->acount = 1;
+	box->base = NULL;
+	box->offset = 0;
+	box->sd[0] = (unsigned long)immediate_value(v);
+	return box;
+}
+
 static void print_value(Value v)
 {
 	fprintf(stderr, "DEBUG:\n");
@@ -38,7 +193,11 @@ static void print_value(Value v)
 
 Value value_make_number(unsigned long value)
 {
-	Value num = mem_alloc(sizeof *num); /* Singleton values are presized. */
+	Value num;
+	if (fits_immediate((long)value)) {
+		return immediate((long)value);
+	}
+	num = mem_alloc(sizeof *num); /* Singleton values are presized. */
 	assert(num); /* TODO: Error handling */
 	num->refcount = 1;
 	num->rank = 0;
@@ -46,64 +205,125 @@ Value value_make_number(unsigned long value)
 	num->acount = 1;
 	num->vec_type = INTEGER;
 	num->type = INTEGER;
+	num->base = NULL;
+	num->offset = 0;
 	num->sd[0] = value;
 	return num;
 }
 
-Value value_make_vector(unsigned long value)
-{
-	const size_t init_count = 10;
-	const unsigned long init_rank = 1;
-	Value vec = mem_alloc(sizeof *vec + sizeof vec->sd[0] * (init_count + 1));
-	assert(vec); /* TODO: Error handling */
-	vec->refcount = 1;
-	vec->rank = init_rank;
-	vec->ecount = 1;
-	vec->acount = init_count;
-	vec->vec_type = INTEGER;
-	vec->type = VECTOR;
-	vec->sd[0] = 1;
-	vec->sd[1] = value;
+Value value_make_vector(const unsigned long* elems, size_t count)
+{
+	Value vec = value_make_ints(count);
+	memcpy(&vec->sd[1], elems, sizeof *elems * count);
 	return vec;
 }
 
-Value value_append(Value v, unsigned long val)
+Value value_make_ints(size_t count)
 {
-	if (v->ecount == v->acount) {
-		v->acount *= 2;
-		v = mem_realloc(v, sizeof *v + sizeof v->sd[0] * (v->acount + v->rank));
-	}
-	assert(v);
-	v->sd[v->rank - 1]++;
-	v->sd[v->rank - 1 + v->ecount++ + 1] = val;
-	return v;
+	const unsigned long shape = count;
+	return make_value(INTEGER, 1, &shape, count);
+}
+
+/* Shortens a vector in place, keeping its first count elements. */
+void value_truncate(Value v, size_t count)
+{
+	assert(v->rank == 1 && count <= v->ecount);
+	v->sd[0] = count;
+	v->ecount = count;
 }
 
 void value_free(Value v)
 {
 	assert(v);
+	if (IMMEDIATE(v) || v->refcount == PINNED) {
+		return;
+	}
 	v->refcount--;
 	if (v->refcount == 0) {
+		if (v->base) {
+			value_free(v->base);
+		}
 		mem_dealloc(v);
 	}
 }
 
-char *value_stringify(Value v)
+/* Integral floats print in full, so promoted sums read like integers. */
+static int print_float(char* buf, size_t len, double d)
+{
+	const double exact = 9007199254740992.0; /* 2^53, all larger are whole. */
+	/* Infinities and NaNs aren't whole, and can't be converted to test. */
+	const int whole = isfinite(d)
+		&& (d >= exact || d <= -exact || d == (double)(long long)d);
+	if (whole && d > -1e20 && d < 1e20) {
+		return snprintf(buf, len, "%.0f ", d);
+	}
+	return snprintf(buf, len, "%.17g ", d);
+}
+
+/* Element i of v in decimal, then a space. Returns the length written. */
+static int print_elem(char* buf, size_t len, Value v, size_t i)
+{
+	if (v->vec_type == FLOAT) {
+		return print_float(buf, len, floats(v)[i]);
+	} else if (v->vec_type == BOOLEAN) {
+		return snprintf(buf, len, "%lu ", get_bit(v, i));
+	}
+	return snprintf(buf, len, "%ld ", ints(v)[i]);
+}
+
+static char *stringify(Value v)
 {
-	const size_t UINT64_DIGITS = 20; /* log(2^64) / log(10) = 19.3 ~ 20. */
-	/* I.e. the maximum length of an integer printed in decimal. */
-	const size_t len = (UINT64_DIGITS + 1) * (v->ecount + 2) * (v->rank + 1);
+	const size_t FLOAT_DIGITS = 24; /* -d.dddddddddddddddde+ddd */
+	/* I.e. the maximum length of an element printed in decimal. */
+	const size_t len = (FLOAT_DIGITS + 1) * (v->ecount + 2) * (v->rank + 1);
 	/* ' ' between values, 2 '\n's between dimensions, and '\0' terminator. */
 	char *tmp = mem_alloc(len);
-	assert(tmp); /* TODO: Error handling */
+	/* Higher ranks print a row per line, with columns right aligned and a
+	 * blank line between planes. */
+	const size_t cols = v->rank > 1 ? v->sd[v->rank - 1] : 0;
+	const size_t plane = cols ? cols * v->sd[v->rank - 2] : 0;
+	size_t* width = cols ? mem_alloc(sizeof *width * cols) : NULL;
+	char elem[64];
 	size_t pos = 0;
+	assert(tmp && (width || !cols)); /* TODO: Error handling */
+	if (cols) {
+		memset(width, 0, sizeof *width * cols);
+		for (size_t i = 0; i < v->ecount; ++i) {
+			const size_t n = (size_t)print_elem(elem, sizeof elem, v, i) - 1;
+			width[i % cols] = n > width[i % cols] ? n : width[i % cols];
+		}
+	}
 	for (size_t i = 0; i < v->ecount; ++i) {
-		pos += snprintf((tmp + pos), len - pos, "%ld ", v->sd[v->rank + i]);
+		if (!cols) {
+			pos += (size_t)print_elem(tmp + pos, len - pos, v, i);
+			continue;
+		}
+		{
+			const size_t n = (size_t)print_elem(elem, sizeof elem, v, i) - 1;
+			memset(tmp + pos, ' ', width[i % cols] - n);
+			pos += width[i % cols] - n;
+			memcpy(tmp + pos, elem, n);
+			pos += n;
+			tmp[pos++] = (i + 1) % cols ? ' ' : '\n';
+			if (v->rank > 2 && (i + 1) % plane == 0) {
+				tmp[pos++] = '\n';
+			}
+		}
+	}
+	while (pos && (tmp[pos - 1] == ' ' || tmp[pos - 1] == '\n')) {
+		pos--; /* Remove trailing space */
 	}
-	tmp[--pos] = '\0'; /* Remove trailing space */
+	tmp[pos] = '\0';
+	mem_dealloc(width);
 	return tmp;
 }
 
+char *value_stringify(Value v)
+{
+	struct Value_ box;
+	return stringify(unbox(v, &box));
+}
+
 /* Determines rank before which a and w agree. Assumes rank a >= rank w */
 static size_t agreed_prefix(Value a, Value w)
 {
@@ -115,60 +335,2260 @@ static size_t agreed_prefix(Value a, Value w)
 	return w->rank;
 }
 
-/* Creates a Value with the same shape, type, and ecount as that given. */
-static Value copy_value_container(Value v)
+/* Creates a Value with the same shape and ecount as that given. */
+static Value copy_value_container(Value v, enum type t)
 {
-	/* NOTE: This is actually oversizing the array for many types. */
-	Value cpy = mem_alloc(sizeof *cpy +sizeof v->sd[0] *(v->ecount +v->rank));
-	assert(cpy); /* TODO: Error handling */
-	cpy->refcount = 1;
-	cpy->rank = v->rank;
-	cpy->ecount = v->ecount;
-	cpy->acount = v->ecount;
-	cpy->vec_type = v->vec_type;
-	memcpy(&cpy->sd[0], &v->sd[0], sizeof cpy->sd[0] * cpy->rank);
-	return cpy;
+	return make_value(t, v->rank, v->sd, v->ecount);
 }
 
-static Value add_scalar(Value sum, Value vec, Value scalar)
+/*
+ * Orders a dyad's operands so that *a has the higher rank, and checks that
+ * *w's shape prefixes *a's. Returns nonzero if they were swapped. Each
+ * element of *w then pairs with a cell of cell_size() elements of *a.
+*/
+static int conform(Value* a, Value* w)
 {
-	for (size_t i = 0; i < vec->ecount; ++i) {
-		sum->sd[sum->rank + i] = vec->sd[vec->rank + i] + scalar->sd[0];
+	const int swap = (*a)->rank < (*w)->rank;
+	if (swap) {
+		Value t = *a;
+		*a = *w;
+		*w = t;
 	}
-	return sum;
+	if (agreed_prefix(*a, *w) != (*w)->rank) {
+		fprintf(stdout, "Error: mismatched shapes.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	return swap;
 }
 
-Value value_add(Value a, Value w)
+static size_t cell_size(Value a, Value w)
 {
-	if (a->rank < w->rank) { /* Addition is commutative, so swap. */
-		Value t = a;
-		a = w;
-		w = t;
-	} /* Now a->rank >= w->rank */
-	Value sum = copy_value_container(w);
-	assert(sum); /* TODO: Error handling. */
-	if (w->rank == 0) {
-		return add_scalar(sum, a, w);
-	}
-	if (agreed_prefix(a, w) != w->rank) {
-		fprintf(stdout, "Error: mismatched shapes.\n");
-		exit(EXIT_FAILURE); /* TODO: Error handling */
+	return w->ecount ? a->ecount / w->ecount : 1;
+}
+
+/*
+ * Scalar functions. Each dyad has kernels for every shape of its operands:
+ * two runs of elements, or one element broadcast along a run of the other.
+ * Kernels giving integers are overflow checked, returning nonzero if any
+ * element can't be one; the result is then finished in doubles, by kernels
+ * for each pair of operand types. All are generated from an element
+ * function per operator, so every loop is specialized (and vectorized, where
+ * the operation allows) with no dispatch per element.
+*/
+enum shape { VV, VS, SV, SHAPES }; /* Which operand, if either, is one. */
+enum pair { LL, LF, FL, FF, PAIRS }; /* Operand types, long or double. */
+
+struct dyadic {
+	/* NULL if the results are never integers. */
+	int (*ints[SHAPES])(long* r, const long* a, const long* w, size_t n);
+	void (*floats[PAIRS][SHAPES])(double* r, const void* a, const void* w,
+		size_t n);
+};
+
+/* step(x, y, &r) sets r to x f y, returning 1 if that's not an integer. */
+#define INT_KERNELS(name, step) \
+static int name##_ints_vv(long* r, const long* a, const long* w, size_t n) \
+{ \
+	unsigned long fail = 0; \
+	for (size_t i = 0; i < n; ++i) { \
+		fail |= step(a[i], w[i], &r[i]); \
+	} \
+	return fail != 0; \
+} \
+static int name##_ints_vs(long* r, const long* a, const long* w, size_t n) \
+{ \
+	const long y = *w; \
+	unsigned long fail = 0; \
+	for (size_t i = 0; i < n; ++i) { \
+		fail |= step(a[i], y, &r[i]); \
+	} \
+	return fail != 0; \
+} \
+static int name##_ints_sv(long* r, const long* a, const long* w, size_t n) \
+{ \
+	const long x = *a; \
+	unsigned long fail = 0; \
+	for (size_t i = 0; i < n; ++i) { \
+		fail |= step(x, w[i], &r[i]); \
+	} \
+	return fail != 0; \
+}
+
+/* f(x, y) in doubles, for operands of types TA and TW. */
+#define FLOAT_LOOPS(name, TA, TW, f) \
+static void name##_vv(double* r, const void* va, const void* vw, size_t n) \
+{ \
+	const TA* a = va; \
+	const TW* w = vw; \
+	for (size_t i = 0; i < n; ++i) { \
+		r[i] = f((double)a[i], (double)w[i]); \
+	} \
+} \
+static void name##_vs(double* r, const void* va, const void* vw, size_t n) \
+{ \
+	const TA* a = va; \
+	const double y = (double)*(const TW*)vw; \
+	for (size_t i = 0; i < n; ++i) { \
+		r[i] = f((double)a[i], y); \
+	} \
+} \
+static void name##_sv(double* r, const void* va, const void* vw, size_t n) \
+{ \
+	const double x = (double)*(const TA*)va; \
+	const TW* w = vw; \
+	for (size_t i = 0; i < n; ++i) { \
+		r[i] = f(x, (double)w[i]); \
+	} \
+}
+
+#define FLOAT_KERNELS(name, f) \
+	FLOAT_LOOPS(name##_ll, long, long, f) \
+	FLOAT_LOOPS(name##_lf, long, double, f) \
+	FLOAT_LOOPS(name##_fl, double, long, f) \
+	FLOAT_LOOPS(name##_ff, double, double, f)
+
+#define SHAPE_ROW(name) { name##_vv, name##_vs, name##_sv }
+#define FLOAT_TABLE(name) { SHAPE_ROW(name##_ll), SHAPE_ROW(name##_lf), \
+	SHAPE_ROW(name##_fl), SHAPE_ROW(name##_ff) }
+
+/* The kernels of a dyad with integer results where step allows, or not. */
+#define SCALAR_DYAD(name, step, f) \
+	INT_KERNELS(name, step) \
+	FLOAT_KERNELS(name, f) \
+	static const struct dyadic name##_dyadic = { \
+		SHAPE_ROW(name##_ints), FLOAT_TABLE(name) \
+	};
+#define FLOAT_DYAD(name, f) \
+	FLOAT_KERNELS(name, f) \
+	static const struct dyadic name##_dyadic = { \
+		{ NULL, NULL, NULL }, FLOAT_TABLE(name) \
+	};
+
+/*
+ * Signed overflow happened iff both operands differ in sign from the sum
+ * (or x's sign differs from both y's and the difference's), so the checks
+ * are branch free and vectorize with the plain arithmetic.
+*/
+static unsigned long add_step(long x, long y, long* r)
+{
+	const unsigned long s = (unsigned long)x + (unsigned long)y;
+	*r = (long)s;
+	return (((unsigned long)x ^ s) & ((unsigned long)y ^ s)) >> (WORD_BITS - 1);
+}
+
+static unsigned long sub_step(long x, long y, long* r)
+{
+	const unsigned long d = (unsigned long)x - (unsigned long)y;
+	*r = (long)d;
+	return (((unsigned long)x ^ (unsigned long)y) & ((unsigned long)x ^ d))
+		>> (WORD_BITS - 1);
+}
+
+static unsigned long mul_step(long x, long y, long* r)
+{
+	return __builtin_mul_overflow(x, y, r);
+}
+
+static unsigned long max_step(long x, long y, long* r)
+{
+	*r = x > y ? x : y;
+	return 0;
+}
+
+static unsigned long min_step(long x, long y, long* r)
+{
+	*r = x < y ? x : y;
+	return 0;
+}
+
+/* x|y: y modulo x, taking x's sign, and y itself if x is 0. */
+static unsigned long res_step(long x, long y, long* r)
+{
+	long m;
+	if (x == 0 || x == -1) { /* LONG_MIN % -1 traps. */
+		*r = x ? 0 : y;
+		return 0;
 	}
-	/* TODO: Error handling. */
-	/* TODO:
-	 * Still not correct for prefix agreed case.
-	 * (Need to duplicated operation).
-	*/
-	for (size_t shape = 0, i = 0; shape < agreed_prefix(a, w); ++shape) {
-		for (size_t j = 0; j < a->sd[shape]; j++, ++i) {
-			sum->sd[sum->rank + i] = a->sd[a->rank + i] + w->sd[w->rank + i];
+	m = y % x;
+	*r = m && (m < 0) != (x < 0) ? m + x : m;
+	return 0;
+}
+
+/* By squaring. Negative powers aren't integers. */
+static unsigned long pow_step(long x, long y, long* r)
+{
+	unsigned long fail = y < 0;
+	long p = 1;
+	for (; y > 0; y >>= 1) {
+		if (y & 1) {
+			fail |= __builtin_mul_overflow(p, x, &p);
+		}
+		if (y > 1) {
+			fail |= __builtin_mul_overflow(x, x, &x);
 		}
 	}
-	return sum;
+	*r = p;
+	return fail;
 }
 
-Value value_reference(Value v)
+static double add_float(double x, double y)
 {
-	v->refcount++;
-	return v;
+	return x + y;
+}
+
+static double sub_float(double x, double y)
+{
+	return x - y;
+}
+
+static double mul_float(double x, double y)
+{
+	return x * y;
+}
+
+/* IEEE, except that 0÷0 is 1, as in APL. */
+static double div_float(double x, double y)
+{
+	return x == 0 && y == 0 ? 1 : x / y;
+}
+
+static double max_float(double x, double y)
+{
+	return x > y ? x : y;
+}
+
+static double min_float(double x, double y)
+{
+	return x < y ? x : y;
+}
+
+static double res_float(double x, double y)
+{
+	double m;
+	if (x == 0) {
+		return y;
+	}
+	m = fmod(y, x);
+	return m != 0 && (m < 0) != (x < 0) ? m + x : m;
+}
+
+static double pow_float(double x, double y)
+{
+	return pow(x, y);
+}
+
+SCALAR_DYAD(add, add_step, add_float)
+SCALAR_DYAD(sub, sub_step, sub_float)
+SCALAR_DYAD(mul, mul_step, mul_float)
+FLOAT_DYAD(div, div_float)
+SCALAR_DYAD(max, max_step, max_float)
+SCALAR_DYAD(min, min_step, min_float)
+SCALAR_DYAD(res, res_step, res_float)
+SCALAR_DYAD(pow, pow_step, pow_float)
+
+/*
+ * Reductions fold a row of n (at least one) elements from the right,
+ * x f (y f (... f z)), from the same element functions. Integer folds fail
+ * as the kernels do, and the row is then folded again in doubles.
+*/
+struct reduction {
+	int (*ints)(long* r, const long* a, size_t n); /* NULL if never integers. */
+	double (*floats[2])(const void* a, size_t n); /* Of longs, of doubles. */
+	double identity; /* The result for an empty row. */
+};
+
+#define FOLD_INTS(name, step) \
+static int name##_fold_ints(long* r, const long* a, size_t n) \
+{ \
+	unsigned long fail = 0; \
+	long acc = a[n - 1]; \
+	for (size_t i = n - 1; i-- > 0; ) { \
+		fail |= step(a[i], acc, &acc); \
+	} \
+	*r = acc; \
+	return fail != 0; \
+}
+
+#define FOLD_FLOATS(name, T, f) \
+static double name(const void* va, size_t n) \
+{ \
+	const T* a = va; \
+	double acc = (double)a[n - 1]; \
+	for (size_t i = n - 1; i-- > 0; ) { \
+		acc = f((double)a[i], acc); \
+	} \
+	return acc; \
+}
+
+#define SCALAR_REDUCTION(name, step, f, identity) \
+	FOLD_INTS(name, step) \
+	FOLD_FLOATS(name##_fold_longs, long, f) \
+	FOLD_FLOATS(name##_fold_doubles, double, f) \
+	static const struct reduction name##_reduction = { \
+		name##_fold_ints, { name##_fold_longs, name##_fold_doubles }, identity \
+	};
+#define FLOAT_REDUCTION(name, f, identity) \
+	FOLD_FLOATS(name##_fold_longs, long, f) \
+	FOLD_FLOATS(name##_fold_doubles, double, f) \
+	static const struct reduction name##_reduction = { \
+		NULL, { name##_fold_longs, name##_fold_doubles }, identity \
+	};
+
+SCALAR_REDUCTION(sub, sub_step, sub_float, 0)
+SCALAR_REDUCTION(mul, mul_step, mul_float, 1)
+FLOAT_REDUCTION(div, div_float, 1)
+SCALAR_REDUCTION(max, max_step, max_float, -DBL_MAX)
+SCALAR_REDUCTION(min, min_step, min_float, DBL_MAX)
+SCALAR_REDUCTION(res, res_step, res_float, 0)
+SCALAR_REDUCTION(pow, pow_step, pow_float, 1)
+
+/* Element i of v on, as the kernels take them. */
+static const void* elems_from(Value v, size_t i)
+{
+	if (v->vec_type == FLOAT) {
+		return floats(v) + i;
+	}
+	return ints(v) + i;
+}
+
+/* Element i of v as a double. */
+static double float_at(Value v, size_t i)
+{
+	switch (v->vec_type) {
+	case FLOAT:
+		return floats(v)[i];
+	case BOOLEAN:
+		return (double)get_bit(v, i);
+	default:
+		return (double)ints(v)[i];
+	}
+}
+
+/* Widens the n longs at d to doubles, in place. */
+static void widen_ints(unsigned long* d, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		long l;
+		double f;
+		memcpy(&l, &d[i], sizeof l);
+		f = (double)l;
+		memcpy(&d[i], &f, sizeof f);
+	}
+}
+
+/*
+ * Fills r (shaped as a) with integers, where w's elements each apply to a
+ * cell of cell elements of a, a block at a time until a block fails. If
+ * swap, w is the left operand. If a block fails, the blocks before it are
+ * widened to doubles then and there, and where it starts is returned;
+ * otherwise r's count.
+*/
+static size_t dyadic_ints(Value r, Value a, Value w, size_t cell, int swap,
+		const struct dyadic* k)
+{
+	const long* x = ints(a), *y = ints(w);
+	long* out = ints(r);
+	for (size_t i = 0; i < r->ecount; i += BLOCK) {
+		const size_t n = r->ecount - i < BLOCK ? r->ecount - i : BLOCK;
+		int fail = 0;
+		if (cell == 1) {
+			fail = swap ? k->ints[VV](out + i, y + i, x + i, n)
+				: k->ints[VV](out + i, x + i, y + i, n);
+		} else {
+			for (size_t j = i, end; j < i + n; j = end) {
+				end = (j / cell + 1) * cell;
+				end = end < i + n ? end : i + n;
+				fail |= swap ? k->ints[SV](out + j, y + j / cell, x + j, end - j)
+					: k->ints[VS](out + j, x + j, y + j / cell, end - j);
+			}
+		}
+		if (fail) {
+			widen_ints(data_of(r), i);
+			return i;
+		}
+	}
+	return r->ecount;
+}
+
+/* Like dyadic_ints(), in doubles, from element i on. */
+static void dyadic_floats(Value r, size_t i, Value a, Value w, size_t cell,
+		int swap, const struct dyadic* k)
+{
+	const Value left = swap ? w : a, right = swap ? a : w;
+	void (*const* f)(double*, const void*, const void*, size_t) =
+		k->floats[(left->vec_type == FLOAT) * 2 + (right->vec_type == FLOAT)];
+	if (cell == 1) {
+		f[VV](floats(r) + i, elems_from(left, i), elems_from(right, i),
+			r->ecount - i);
+		return;
+	}
+	for (size_t end; i < r->ecount; i = end) {
+		end = (i / cell + 1) * cell;
+		if (swap) {
+			f[SV](floats(r) + i, elems_from(w, i / cell), elems_from(a, i),
+				end - i);
+		} else {
+			f[VS](floats(r) + i, elems_from(a, i), elems_from(w, i / cell),
+				end - i);
+		}
+	}
+}
+
+Value value_widen(Value v)
+{
+	Value r;
+	if (IMMEDIATE(v) || v->vec_type != BOOLEAN) {
+		return value_reference(v);
+	}
+	r = copy_value_container(v, INTEGER);
+	for (size_t i = 0; i < v->ecount; i += WORD_BITS) {
+		const size_t n = v->ecount - i < WORD_BITS ? v->ecount - i : WORD_BITS;
+		const unsigned long word = bits(v)[i / WORD_BITS];
+		for (size_t j = 0; j < n; ++j) {
+			ints(r)[i + j] = (long)(word >> j & 1);
+		}
+	}
+	return r;
+}
+
+/*
+ * A scalar dyad, on operands widened from booleans. The result stays
+ * integral until a block fails; then only the blocks already written are
+ * widened, and the rest is done in doubles. Two immediates give another,
+ * unless the result is too large for one.
+*/
+static Value dyadic(Value a, Value w, const struct dyadic* k)
+{
+	struct Value_ ab, wb;
+	Value r;
+	size_t cell, i = 0;
+	int swap;
+	if (IMMEDIATE(a) && IMMEDIATE(w) && k->ints[VV]) {
+		const long x = immediate_value(a), y = immediate_value(w);
+		long z;
+		if (!k->ints[VV](&z, &x, &y, 1) && fits_immediate(z)) {
+			return immediate(z);
+		}
+	}
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	if (a->vec_type == BOOLEAN || w->vec_type == BOOLEAN) {
+		Value wa = value_widen(a), ww = value_widen(w);
+		r = dyadic(wa, ww, k);
+		value_free(wa);
+		value_free(ww);
+		return r;
+	}
+	swap = conform(&a, &w);
+	cell = cell_size(a, w);
+	/* A promoted result needs room for doubles, whatever the operands are. */
+	r = copy_value_container(a, FLOAT);
+	r->vec_type = INTEGER;
+	if (a->vec_type == INTEGER && w->vec_type == INTEGER && k->ints[VV]) {
+		i = dyadic_ints(r, a, w, cell, swap, k);
+		if (i == r->ecount) {
+			return r;
+		}
+	}
+	r->vec_type = FLOAT;
+	dyadic_floats(r, i, a, w, cell, swap, k);
+	return r;
+}
+
+Value value_add(Value a, Value w)
+{
+	return dyadic(a, w, &add_dyadic);
+}
+
+Value value_subtract(Value a, Value w)
+{
+	return dyadic(a, w, &sub_dyadic);
+}
+
+Value value_times(Value a, Value w)
+{
+	return dyadic(a, w, &mul_dyadic);
+}
+
+Value value_divide(Value a, Value w)
+{
+	return dyadic(a, w, &div_dyadic);
+}
+
+Value value_max(Value a, Value w)
+{
+	return dyadic(a, w, &max_dyadic);
+}
+
+Value value_min(Value a, Value w)
+{
+	return dyadic(a, w, &min_dyadic);
+}
+
+Value value_residue(Value a, Value w)
+{
+	return dyadic(a, w, &res_dyadic);
+}
+
+Value value_power(Value a, Value w)
+{
+	return dyadic(a, w, &pow_dyadic);
+}
+
+/*
+ * Monadic scalar functions: a checked integer kernel, or NULL if results are
+ * never integers; likewise from doubles, where results can be integers; and
+ * kernels in doubles for either type of operand.
+*/
+struct monadic {
+	int (*ints)(long* r, const long* x, size_t n);
+	int (*to_ints)(long* r, const double* x, size_t n);
+	void (*floats[2])(double* r, const void* x, size_t n);
+};
+
+/* step(x, &r) sets r to f x, returning 1 if that's not an integer. */
+#define MONAD_INTS(name, T, step) \
+static int name(long* r, const T* x, size_t n) \
+{ \
+	unsigned long fail = 0; \
+	for (size_t i = 0; i < n; ++i) { \
+		fail |= step(x[i], &r[i]); \
+	} \
+	return fail != 0; \
+}
+
+#define MONAD_FLOATS(name, T, f) \
+static void name(double* r, const void* vx, size_t n) \
+{ \
+	const T* x = vx; \
+	for (size_t i = 0; i < n; ++i) { \
+		r[i] = f((double)x[i]); \
+	} \
+}
+
+/* The kernels of a monad, with integer results from longs (step) and from
+ * doubles (to_step) where they're allowed. */
+#define SCALAR_MONAD(name, step, to_step, f) \
+	MONAD_INTS(name##_ints, long, step) \
+	MONAD_INTS(name##_to_ints, double, to_step) \
+	FLOAT_MONAD(name, f, name##_ints, name##_to_ints)
+#define FLOAT_MONAD(name, f, ints, to_ints) \
+	MONAD_FLOATS(name##_floats_l, long, f) \
+	MONAD_FLOATS(name##_floats_f, double, f) \
+	static const struct monadic name##_monadic = { \
+		ints, to_ints, { name##_floats_l, name##_floats_f } \
+	};
+#define INT_MONAD(name, step, f) \
+	MONAD_INTS(name##_ints, long, step) \
+	FLOAT_MONAD(name, f, name##_ints, NULL)
+
+static unsigned long neg_step(long x, long* r)
+{
+	return __builtin_sub_overflow(0, x, r);
+}
+
+/* Integral doubles in range, as longs. */
+static unsigned long whole_step(double x, long* r)
+{
+	if (!(x >= (double)LONG_MIN && x < -(double)LONG_MIN)) {
+		return 1;
+	}
+	*r = (long)x;
+	return 0;
+}
+
+static unsigned long sign_step(long x, long* r)
+{
+	*r = (x > 0) - (x < 0);
+	return 0;
+}
+
+static unsigned long sign_of_step(double x, long* r)
+{
+	*r = (x > 0) - (x < 0);
+	return 0;
+}
+
+static unsigned long same_step(long x, long* r)
+{
+	*r = x;
+	return 0;
+}
+
+static unsigned long ceil_of_step(double x, long* r)
+{
+	return whole_step(ceil(x), r);
+}
+
+static unsigned long floor_of_step(double x, long* r)
+{
+	return whole_step(floor(x), r);
+}
+
+static unsigned long abs_step(long x, long* r)
+{
+	const unsigned long m = x < 0 ? -(unsigned long)x : (unsigned long)x;
+	*r = (long)m;
+	return m >> (WORD_BITS - 1); /* Only for LONG_MIN. */
+}
+
+static double neg_float(double x)
+{
+	return -x;
+}
+
+static double sign_float(double x)
+{
+	return (x > 0) - (x < 0);
+}
+
+static double recip_float(double x)
+{
+	return 1 / x;
+}
+
+static double abs_float(double x)
+{
+	return fabs(x);
+}
+
+INT_MONAD(neg, neg_step, neg_float)
+SCALAR_MONAD(sign, sign_step, sign_of_step, sign_float)
+FLOAT_MONAD(recip, recip_float, NULL, NULL)
+SCALAR_MONAD(ceil, same_step, ceil_of_step, ceil)
+SCALAR_MONAD(floor, same_step, floor_of_step, floor)
+INT_MONAD(abs, abs_step, abs_float)
+FLOAT_MONAD(exp, exp, NULL, NULL)
+
+/* Like dyadic(), for a monad. */
+static Value monadic(Value v, const struct monadic* k)
+{
+	struct Value_ box;
+	Value r;
+	size_t i = 0;
+	if (IMMEDIATE(v) && k->ints) {
+		const long x = immediate_value(v);
+		long z;
+		if (!k->ints(&z, &x, 1) && fits_immediate(z)) {
+			return immediate(z);
+		}
+	}
+	v = unbox(v, &box);
+	if (v->vec_type == BOOLEAN) {
+		Value wv = value_widen(v);
+		r = monadic(wv, k);
+		value_free(wv);
+		return r;
+	}
+	r = copy_value_container(v, FLOAT);
+	r->vec_type = INTEGER;
+	if (v->vec_type == INTEGER ? k->ints != NULL : k->to_ints != NULL) {
+		for (; i < r->ecount; i += BLOCK) {
+			const size_t n = r->ecount - i < BLOCK ? r->ecount - i : BLOCK;
+			if (v->vec_type == INTEGER ? k->ints(ints(r) + i, ints(v) + i, n)
+					: k->to_ints(ints(r) + i, floats(v) + i, n)) {
+				widen_ints(data_of(r), i);
+				break;
+			}
+		}
+		if (i >= r->ecount) {
+			return r;
+		}
+	}
+	r->vec_type = FLOAT;
+	k->floats[v->vec_type == FLOAT](floats(r) + i, elems_from(v, i),
+		r->ecount - i);
+	return r;
+}
+
+Value value_negate(Value v)
+{
+	return monadic(v, &neg_monadic);
+}
+
+Value value_signum(Value v)
+{
+	return monadic(v, &sign_monadic);
+}
+
+Value value_reciprocal(Value v)
+{
+	return monadic(v, &recip_monadic);
+}
+
+Value value_ceiling(Value v)
+{
+	return monadic(v, &ceil_monadic);
+}
+
+Value value_floor(Value v)
+{
+	return monadic(v, &floor_monadic);
+}
+
+Value value_magnitude(Value v)
+{
+	return monadic(v, &abs_monadic);
+}
+
+Value value_exp(Value v)
+{
+	return monadic(v, &exp_monadic);
+}
+
+/*
+ * Comparisons produce booleans, packed a word at a time. Each kind has a
+ * kernel for integers, one for anything mixed with floats (compared as
+ * doubles), and a whole word one for two boolean operands of equal shape.
+*/
+enum cmp { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+
+/* The comparison giving the same result with its operands swapped. */
+static const enum cmp swapped[] = {
+	[CMP_EQ] = CMP_EQ, [CMP_NE] = CMP_NE, [CMP_LT] = CMP_GT,
+	[CMP_LE] = CMP_GE, [CMP_GT] = CMP_LT, [CMP_GE] = CMP_LE,
+};
+
+/*
+ * Packs test for i in [0, n) into the words of r, where test reads element
+ * i of the left operand and element i / cell of the right.
+*/
+#define PACK_BITS(r, n, test) \
+	for (size_t i_ = 0; i_ < (n); i_ += WORD_BITS) { \
+		const size_t m_ = (n) - i_ < WORD_BITS ? (n) - i_ : WORD_BITS; \
+		unsigned long word_ = 0; \
+		for (size_t j_ = 0; j_ < m_; ++j_) { \
+			const size_t i = i_ + j_; \
+			word_ |= (unsigned long)(test) << j_; \
+		} \
+		(r)[i_ / WORD_BITS] = word_; \
+	}
+
+#define COMPARISON(name, OP, BITS) \
+static void name##_ints(unsigned long* r, const long* a, const long* w, \
+		size_t n, size_t cell) \
+{ \
+	if (cell == 1) { \
+		PACK_BITS(r, n, a[i] OP w[i]) \
+	} else { \
+		PACK_BITS(r, n, a[i] OP w[i / cell]) \
+	} \
+} \
+static void name##_floats(unsigned long* r, Value a, Value w, \
+		size_t n, size_t cell) \
+{ \
+	PACK_BITS(r, n, float_at(a, i) OP float_at(w, i / cell)) \
+} \
+static void name##_bits(unsigned long* r, const unsigned long* a, \
+		const unsigned long* w, size_t n) \
+{ \
+	for (size_t k = 0; k < n; ++k) { \
+		const unsigned long x = a[k], y = w[k]; \
+		r[k] = BITS; \
+	} \
+}
+
+COMPARISON(eq, ==, ~(x ^ y))
+COMPARISON(ne, !=, x ^ y)
+COMPARISON(lt, <, ~x & y)
+COMPARISON(le, <=, ~x | y)
+COMPARISON(gt, >, x & ~y)
+COMPARISON(ge, >=, x | ~y)
+
+static const struct comparison {
+	void (*ints)(unsigned long*, const long*, const long*, size_t, size_t);
+	void (*floats)(unsigned long*, Value, Value, size_t, size_t);
+	void (*bits)(unsigned long*, const unsigned long*, const unsigned long*,
+		size_t);
+} comparisons[] = {
+	[CMP_EQ] = { eq_ints, eq_floats, eq_bits },
+	[CMP_NE] = { ne_ints, ne_floats, ne_bits },
+	[CMP_LT] = { lt_ints, lt_floats, lt_bits },
+	[CMP_LE] = { le_ints, le_floats, le_bits },
+	[CMP_GT] = { gt_ints, gt_floats, gt_bits },
+	[CMP_GE] = { ge_ints, ge_floats, ge_bits },
+};
+
+static Value compare(Value a, Value w, enum cmp op)
+{
+	struct Value_ ab, wb;
+	Value r;
+	size_t cell;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	if (conform(&a, &w)) {
+		op = swapped[op];
+	}
+	cell = cell_size(a, w);
+	if ((a->vec_type == BOOLEAN || w->vec_type == BOOLEAN)
+			&& (a->vec_type != w->vec_type || cell != 1)) {
+		Value wa = value_widen(a), ww = value_widen(w);
+		r = compare(wa, ww, op);
+		value_free(wa);
+		value_free(ww);
+		return r;
+	}
+	r = copy_value_container(a, BOOLEAN);
+	if (a->vec_type == BOOLEAN) {
+		comparisons[op].bits(bits(r), bits(a), bits(w), words(a->ecount));
+		clear_tail(r);
+	} else if (a->vec_type == INTEGER && w->vec_type == INTEGER) {
+		comparisons[op].ints(bits(r), ints(a), ints(w), a->ecount, cell);
+	} else {
+		comparisons[op].floats(bits(r), a, w, a->ecount, cell);
+	}
+	return r;
+}
+
+Value value_equal(Value a, Value w)
+{
+	return compare(a, w, CMP_EQ);
+}
+
+Value value_not_equal(Value a, Value w)
+{
+	return compare(a, w, CMP_NE);
+}
+
+Value value_less(Value a, Value w)
+{
+	return compare(a, w, CMP_LT);
+}
+
+Value value_less_equal(Value a, Value w)
+{
+	return compare(a, w, CMP_LE);
+}
+
+Value value_greater(Value a, Value w)
+{
+	return compare(a, w, CMP_GT);
+}
+
+Value value_greater_equal(Value a, Value w)
+{
+	return compare(a, w, CMP_GE);
+}
+
+/* v as booleans. Other types are accepted if every element is 0 or 1. */
+static Value as_bools(Value v)
+{
+	Value r;
+	if (v->vec_type == BOOLEAN) {
+		return value_reference(v);
+	}
+	r = copy_value_container(v, BOOLEAN);
+	for (size_t i = 0; i < v->ecount; ++i) {
+		const double x = float_at(v, i);
+		if (x != 0 && x != 1) {
+			fprintf(stdout, "Error: domain error.\n");
+			exit(EXIT_FAILURE); /* TODO: Error handling */
+		}
+		bits(r)[i / WORD_BITS] |= (unsigned long)x << (i % WORD_BITS);
+	}
+	return r;
+}
+
+/* And (or, with or set), a word at a time where the shapes allow. */
+static Value logic(Value a, Value w, int or)
+{
+	struct Value_ ab, wb;
+	Value ba, bw, r;
+	size_t cell;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	conform(&a, &w); /* Both are commutative. */
+	ba = as_bools(a);
+	bw = as_bools(w);
+	cell = cell_size(a, w);
+	r = copy_value_container(ba, BOOLEAN);
+	if (cell == 1 || bw->ecount == 1) {
+		/* A single right element applies to every word alike. */
+		const unsigned long all = bw->ecount == 1 && get_bit(bw, 0) ? ~0UL : 0;
+		const unsigned long* x = bits(ba), *y = bits(bw);
+		for (size_t k = 0; k < words(r->ecount); ++k) {
+			const unsigned long yk = cell == 1 ? y[k] : all;
+			bits(r)[k] = or ? x[k] | yk : x[k] & yk;
+		}
+		clear_tail(r);
+	} else if (or) {
+		PACK_BITS(bits(r), r->ecount, get_bit(ba, i) | get_bit(bw, i / cell))
+	} else {
+		PACK_BITS(bits(r), r->ecount, get_bit(ba, i) & get_bit(bw, i / cell))
+	}
+	value_free(ba);
+	value_free(bw);
+	return r;
+}
+
+Value value_and(Value a, Value w)
+{
+	return logic(a, w, 0);
+}
+
+Value value_or(Value a, Value w)
+{
+	return logic(a, w, 1);
+}
+
+Value value_not(Value v)
+{
+	struct Value_ box;
+	Value b = as_bools(unbox(v, &box));
+	Value r = copy_value_container(b, BOOLEAN);
+	for (size_t k = 0; k < words(r->ecount); ++k) {
+		bits(r)[k] = ~bits(b)[k];
+	}
+	clear_tail(r);
+	value_free(b);
+	return r;
+}
+
+/*
+ * Outer products. Each scalar dyad has row kernels giving x f w[j] for one
+ * left element x and a run of the right: the arithmetic dyads' scalar-vector
+ * kernels, or rows of bits for comparisons and logic. Products fill a
+ * preallocated result a tile of the right at a time, over a block of rows,
+ * so the tile stays in cache while the left is broadcast down it.
+*/
+#define OUTER_TILE 2048 /* Right elements per tile. */
+#define OUTER_PARALLEL 65536 /* Smaller products aren't split. */
+
+/*
+ * Like PACK_BITS, for bits at + j of r for j in [0, n), or-ing each word in
+ * once. test reads j.
+*/
+#define PACK_BITS_AT(r, at, n, test) \
+	for (size_t j_ = 0; j_ < (n); ) { \
+		const size_t b_ = ((at) + j_) % WORD_BITS; \
+		const size_t m_ = (n) - j_ < WORD_BITS - b_ ? (n) - j_ : WORD_BITS - b_; \
+		unsigned long word_ = 0; \
+		for (size_t k_ = 0; k_ < m_; ++k_) { \
+			const size_t j = j_ + k_; \
+			word_ |= (unsigned long)(test) << k_; \
+		} \
+		(r)[((at) + j_) / WORD_BITS] |= word_ << b_; \
+		j_ += m_; \
+	}
+
+#define OUTER_TEST(name, OP) \
+static void name##_outer_ints(unsigned long* r, size_t at, long x, \
+		const long* w, size_t n) \
+{ \
+	PACK_BITS_AT(r, at, n, x OP w[j]) \
+} \
+static void name##_outer_floats(unsigned long* r, size_t at, double x, \
+		const double* w, size_t n) \
+{ \
+	PACK_BITS_AT(r, at, n, x OP w[j]) \
+}
+
+OUTER_TEST(eq, ==)
+OUTER_TEST(ne, !=)
+OUTER_TEST(lt, <)
+OUTER_TEST(le, <=)
+OUTER_TEST(gt, >)
+OUTER_TEST(ge, >=)
+
+/* Operands of ∧ and ∨ are 0 or 1, so they're only ever integers. */
+static void and_outer_ints(unsigned long* r, size_t at, long x, const long* w,
+		size_t n)
+{
+	PACK_BITS_AT(r, at, n, x & w[j])
+}
+
+static void or_outer_ints(unsigned long* r, size_t at, long x, const long* w,
+		size_t n)
+{
+	PACK_BITS_AT(r, at, n, x | w[j])
+}
+
+static const struct outer_op {
+	Value (*dyad)(Value, Value);
+	const struct dyadic* arith; /* Numeric rows, or NULL. */
+	/* Boolean rows, written to bits at + j of r. */
+	void (*bits_ints)(unsigned long* r, size_t at, long x, const long* w,
+		size_t n);
+	void (*bits_floats)(unsigned long* r, size_t at, double x,
+		const double* w, size_t n);
+	int logical; /* Operands must be 0 or 1. */
+} outer_ops[] = {
+	{ value_add, &add_dyadic, NULL, NULL, 0 },
+	{ value_subtract, &sub_dyadic, NULL, NULL, 0 },
+	{ value_times, &mul_dyadic, NULL, NULL, 0 },
+	{ value_divide, &div_dyadic, NULL, NULL, 0 },
+	{ value_max, &max_dyadic, NULL, NULL, 0 },
+	{ value_min, &min_dyadic, NULL, NULL, 0 },
+	{ value_residue, &res_dyadic, NULL, NULL, 0 },
+	{ value_power, &pow_dyadic, NULL, NULL, 0 },
+	{ value_equal, NULL, eq_outer_ints, eq_outer_floats, 0 },
+	{ value_not_equal, NULL, ne_outer_ints, ne_outer_floats, 0 },
+	{ value_less, NULL, lt_outer_ints, lt_outer_floats, 0 },
+	{ value_less_equal, NULL, le_outer_ints, le_outer_floats, 0 },
+	{ value_greater, NULL, gt_outer_ints, gt_outer_floats, 0 },
+	{ value_greater_equal, NULL, ge_outer_ints, ge_outer_floats, 0 },
+	{ value_and, NULL, and_outer_ints, NULL, 1 },
+	{ value_or, NULL, or_outer_ints, NULL, 1 },
+};
+
+/* A product split into tasks of rows rows each. */
+struct outer {
+	const struct outer_op* op;
+	Value r;
+	unsigned long* out; /* r's elements. */
+	size_t n, m; /* Left and right elements. */
+	size_t rows;
+	const long* ia, *iw; /* The operands, as integers or doubles. */
+	const double* fa, *fw;
+	unsigned char* overflow; /* For each task. */
+};
+
+static void outer_rows(void* arg, size_t task)
+{
+	struct outer* o = arg;
+	const size_t from = task * o->rows;
+	const size_t to = o->n - from < o->rows ? o->n : from + o->rows;
+	for (size_t c = 0; c < o->m; c += OUTER_TILE) {
+		const size_t len = o->m - c < OUTER_TILE ? o->m - c : OUTER_TILE;
+		for (size_t i = from; i < to; ++i) {
+			const size_t at = i * o->m + c;
+			if (o->r->vec_type == BOOLEAN && o->fa) {
+				o->op->bits_floats(o->out, at, o->fa[i], o->fw + c, len);
+			} else if (o->r->vec_type == BOOLEAN) {
+				o->op->bits_ints(o->out, at, o->ia[i], o->iw + c, len);
+			} else if (o->fa) {
+				o->op->arith->floats[FF][SV]((double*)o->out + at, &o->fa[i],
+					o->fw + c, len);
+			} else {
+				o->overflow[task] |= o->op->arith->ints[SV]((long*)o->out + at,
+					&o->ia[i], o->iw + c, len);
+			}
+		}
+	}
+}
+
+/* v's elements as doubles, in a new buffer. */
+static double* as_doubles(Value v)
+{
+	double* d = mem_alloc(sizeof *d * (v->ecount ? v->ecount : 1));
+	assert(d); /* TODO: Error handling */
+	for (size_t i = 0; i < v->ecount; ++i) {
+		d[i] = float_at(v, i);
+	}
+	return d;
+}
+
+/* Runs the product's tasks, returning nonzero if any overflowed. */
+static int outer_run(struct outer* o)
+{
+	const size_t tasks = o->n ? (o->n + o->rows - 1) / o->rows : 0;
+	int overflow = 0;
+	memset(o->overflow, 0, tasks);
+	pool_run(tasks, outer_rows, o);
+	for (size_t k = 0; k < tasks; ++k) {
+		overflow |= o->overflow[k];
+	}
+	return overflow;
+}
+
+Value value_outer(Value a, Value w, Value (*f)(Value, Value))
+{
+	const struct outer_op* op = NULL;
+	struct outer o;
+	struct Value_ ab, wb;
+	Value wa, ww;
+	unsigned long rank;
+	size_t parts = 1;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	for (size_t k = 0; k < sizeof outer_ops / sizeof outer_ops[0]; ++k) {
+		if (outer_ops[k].dyad == f) {
+			op = &outer_ops[k];
+		}
+	}
+	if (!op) {
+		fprintf(stdout, "Error: domain error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	wa = op->logical ? as_bools(a) : value_reference(a);
+	ww = op->logical ? as_bools(w) : value_reference(w);
+	rank = a->rank + w->rank;
+	o.op = op;
+	o.n = a->ecount;
+	o.m = w->ecount;
+	o.r = make_value(op->arith ? INTEGER : BOOLEAN, rank, NULL, o.n * o.m);
+	memcpy(o.r->sd, a->sd, sizeof a->sd[0] * a->rank);
+	memcpy(o.r->sd + a->rank, w->sd, sizeof w->sd[0] * w->rank);
+	o.out = data_of(o.r);
+	if (o.n * o.m >= OUTER_PARALLEL) {
+		parts = pool_threads();
+	}
+	o.rows = (o.n + parts - 1) / parts;
+	if (o.r->vec_type == BOOLEAN) { /* Tasks mustn't share words. */
+		o.rows = (o.rows + WORD_BITS - 1) / WORD_BITS * WORD_BITS;
+	}
+	o.rows = o.rows ? o.rows : 1;
+	o.overflow = mem_alloc(parts + 1);
+	assert(o.overflow); /* TODO: Error handling */
+	o.ia = o.iw = NULL;
+	o.fa = o.fw = NULL;
+	if (wa->vec_type == FLOAT || ww->vec_type == FLOAT
+			|| (op->arith && !op->arith->ints[SV])) {
+		o.fa = as_doubles(wa);
+		o.fw = as_doubles(ww);
+		o.r->vec_type = o.r->vec_type == BOOLEAN ? BOOLEAN : FLOAT;
+		outer_run(&o);
+	} else {
+		Value ia = value_widen(wa), iw = value_widen(ww);
+		o.ia = ints(ia);
+		o.iw = ints(iw);
+		if (outer_run(&o)) { /* Some results weren't integers: redo as doubles. */
+			o.fa = as_doubles(ia);
+			o.fw = as_doubles(iw);
+			o.r->vec_type = FLOAT;
+			outer_run(&o);
+		}
+		value_free(ia);
+		value_free(iw);
+	}
+	mem_dealloc((double*)o.fa);
+	mem_dealloc((double*)o.fw);
+	mem_dealloc(o.overflow);
+	value_free(wa);
+	value_free(ww);
+	return o.r;
+}
+
+/*
+ * Inner products. +.× multiplies matrices with a blocked kernel: a KC deep
+ * panel of the right is packed into strips NR columns wide, then each block
+ * of MC left rows into strips MR rows high, and a micro kernel keeps an MR by
+ * NR tile of the result in registers while running down both strips. Row
+ * blocks are split across the thread pool. Other pairs go a row of the
+ * result at a time, through the primitives themselves.
+*/
+#define MR 4
+#define NR 8
+#define KC 256
+#define MC 64
+#define NC 512
+#define INNER_PARALLEL (1 << 20) /* Multiply-adds; fewer aren't split. */
+
+/* A panel: rows [p0, p0 + kc) of the right, columns [j0, j0 + nc). */
+struct gemm {
+	size_t n, k, m;
+	const void* a;
+	const void* bp; /* The panel, packed. */
+	void* c;
+	size_t p0, kc, j0, nc;
+};
+
+/* Packs rows of a (lda wide) into MR high strips, zero padded. */
+#define PACK_A(name, T) \
+static void name(T* to, const T* a, size_t lda, size_t mc, size_t kc) \
+{ \
+	for (size_t s = 0; s < mc; s += MR) { \
+		for (size_t p = 0; p < kc; ++p) { \
+			for (size_t i = 0; i < MR; ++i) { \
+				*to++ = s + i < mc ? a[(s + i) * lda + p] : 0; \
+			} \
+		} \
+	} \
+}
+
+/* Packs a panel of b (ldb wide) into NR wide strips, zero padded. */
+#define PACK_B(name, T) \
+static void name(void* out, const void* in, size_t ldb, size_t kc, size_t nc) \
+{ \
+	T* to = out; \
+	const T* b = in; \
+	for (size_t s = 0; s < nc; s += NR) { \
+		for (size_t p = 0; p < kc; ++p) { \
+			for (size_t j = 0; j < NR; ++j) { \
+				*to++ = s + j < nc ? b[p * ldb + s + j] : 0; \
+			} \
+		} \
+	} \
+}
+
+/* Adds the product of an MR strip of a and an NR strip of b to c's mr × nr
+ * corner. */
+#define MICRO(name, T, ATTR) \
+ATTR static void name(T* c, size_t ldc, const T* a, const T* b, size_t kc, \
+		size_t mr, size_t nr) \
+{ \
+	T acc[MR][NR] = { { 0 } }; \
+	for (size_t p = 0; p < kc; ++p, a += MR, b += NR) { \
+		for (size_t i = 0; i < MR; ++i) { \
+			for (size_t j = 0; j < NR; ++j) { \
+				acc[i][j] += a[i] * b[j]; \
+			} \
+		} \
+	} \
+	for (size_t i = 0; i < mr; ++i) { \
+		for (size_t j = 0; j < nr; ++j) { \
+			c[i * ldc + j] += acc[i][j]; \
+		} \
+	} \
+}
+
+/* One task: a block of MC rows against the current panel. */
+#define GEMM_BLOCK(name, T, pack_a, micro) \
+static void name(void* arg, size_t ib) \
+{ \
+	const struct gemm* g = arg; \
+	const size_t i0 = ib * MC; \
+	const size_t mc = g->n - i0 < MC ? g->n - i0 : MC; \
+	const T* bp = g->bp; \
+	T* c = (T*)g->c + i0 * g->m + g->j0; \
+	T* ap = mem_alloc(sizeof *ap * MC * KC); \
+	assert(ap); /* TODO: Error handling */ \
+	pack_a(ap, (const T*)g->a + i0 * g->k + g->p0, g->k, mc, g->kc); \
+	for (size_t jr = 0; jr < g->nc; jr += NR) { \
+		for (size_t ir = 0; ir < mc; ir += MR) { \
+			micro(c + ir * g->m + jr, g->m, ap + ir * g->kc, bp + jr * g->kc, \
+				g->kc, mc - ir < MR ? mc - ir : MR, \
+				g->nc - jr < NR ? g->nc - jr : NR); \
+		} \
+	} \
+	mem_dealloc(ap); \
+}
+
+PACK_A(pack_a_ints, long)
+PACK_A(pack_a_floats, double)
+PACK_B(pack_b_ints, long)
+PACK_B(pack_b_floats, double)
+MICRO(micro_ints, long, )
+MICRO(micro_floats, double, )
+GEMM_BLOCK(gemm_block_ints, long, pack_a_ints, micro_ints)
+GEMM_BLOCK(gemm_block_floats, double, pack_a_floats, micro_floats)
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+/* Built for AVX2 and FMA, and only called if the CPU has them. */
+MICRO(micro_floats_avx2, double, __attribute__((target("avx2,fma"))))
+GEMM_BLOCK(gemm_block_floats_avx2, double, pack_a_floats, micro_floats_avx2)
+#endif
+
+/* c (n × m, zeroed) += a (n × k) +.× b (k × m), elements size bytes. */
+static void gemm(void* c, const void* a, const void* b, size_t n, size_t k,
+		size_t m, size_t size,
+		void (*pack_b)(void*, const void*, size_t, size_t, size_t),
+		void (*block)(void*, size_t))
+{
+	struct gemm g = { n, k, m, a, NULL, c, 0, 0, 0, 0 };
+	const size_t blocks = (n + MC - 1) / MC;
+	void* bp = mem_alloc(size * KC * NC);
+	assert(bp); /* TODO: Error handling */
+	g.bp = bp;
+	for (g.j0 = 0; g.j0 < m; g.j0 += NC) {
+		g.nc = m - g.j0 < NC ? m - g.j0 : NC;
+		for (g.p0 = 0; g.p0 < k; g.p0 += KC) {
+			g.kc = k - g.p0 < KC ? k - g.p0 : KC;
+			pack_b(bp, (const char*)b + size * (g.p0 * m + g.j0), m, g.kc, g.nc);
+			if ((double)n * k * m < INNER_PARALLEL) {
+				for (size_t ib = 0; ib < blocks; ++ib) {
+					block(&g, ib);
+				}
+			} else {
+				pool_run(blocks, block, &g);
+			}
+		}
+	}
+	mem_dealloc(bp);
+}
+
+static void gemm_floats(double* c, const double* a, const double* b,
+		size_t n, size_t k, size_t m)
+{
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		gemm(c, a, b, n, k, m, sizeof *c, pack_b_floats,
+			gemm_block_floats_avx2);
+		return;
+	}
+#endif
+	gemm(c, a, b, n, k, m, sizeof *c, pack_b_floats, gemm_block_floats);
+}
+
+/* Whether every sum of k products of elements of a and b fits in a long. */
+static int products_fit(const long* a, size_t na, const long* b, size_t nb,
+		size_t k)
+{
+	unsigned long ma = 0, mb = 0, p;
+	for (size_t i = 0; i < na; ++i) {
+		const unsigned long x = a[i] < 0 ? -(unsigned long)a[i] : (unsigned long)a[i];
+		ma = x > ma ? x : ma;
+	}
+	for (size_t i = 0; i < nb; ++i) {
+		const unsigned long x = b[i] < 0 ? -(unsigned long)b[i] : (unsigned long)b[i];
+		mb = x > mb ? x : mb;
+	}
+	return !__builtin_mul_overflow(ma, mb, &p) && !__builtin_mul_overflow(p, k, &p)
+		&& p <= LONG_MAX;
+}
+
+/* c (zeroed) = a +.× b, checking every step. Nonzero if any overflowed. */
+static int gemm_ints_checked(long* c, const long* a, const long* b, size_t n,
+		size_t k, size_t m)
+{
+	int ovf = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t p = 0; p < k; ++p) {
+			const long x = a[i * k + p];
+			for (size_t j = 0; j < m; ++j) {
+				long t;
+				ovf |= __builtin_mul_overflow(x, b[p * m + j], &t);
+				ovf |= __builtin_add_overflow(c[i * m + j], t, &c[i * m + j]);
+			}
+		}
+	}
+	return ovf;
+}
+
+/* The elements of v as doubles: its own, or converted into a new buffer. */
+static const double* doubles_of(Value v, double** owned)
+{
+	if (v->vec_type == FLOAT) {
+		*owned = NULL;
+		return floats(v);
+	}
+	return *owned = as_doubles(v);
+}
+
+/*
+ * a +.× w, as n × k by k × m matrices. Booleans widen to longs, and integer
+ * products accumulate in longs when the operands' magnitudes show no sum
+ * can overflow. Otherwise every step is checked, and an overflow redoes the
+ * whole product in doubles, as + does.
+*/
+static Value matmul(Value a, Value w, size_t n, size_t k, size_t m,
+		unsigned long rank)
+{
+	Value r = make_value(FLOAT, rank, NULL, n * m);
+	memset(data_of(r), 0, sizeof(double) * n * m);
+	if (a->vec_type != FLOAT && w->vec_type != FLOAT) {
+		Value ia = value_widen(a), iw = value_widen(w);
+		int ovf = 0;
+		r->vec_type = INTEGER;
+		if (products_fit(ints(ia), n * k, ints(iw), k * m, k)) {
+			gemm(ints(r), ints(ia), ints(iw), n, k, m, sizeof(long),
+				pack_b_ints, gemm_block_ints);
+		} else {
+			ovf = gemm_ints_checked(ints(r), ints(ia), ints(iw), n, k, m);
+		}
+		value_free(ia);
+		value_free(iw);
+		if (!ovf) {
+			return r;
+		}
+		r->vec_type = FLOAT;
+		memset(data_of(r), 0, sizeof(double) * n * m);
+	}
+	{
+		double* fa, *fw;
+		const double* da = doubles_of(a, &fa), *dw = doubles_of(w, &fw);
+		gemm_floats(floats(r), da, dw, n, k, m);
+		mem_dealloc(fa);
+		mem_dealloc(fw);
+	}
+	return r;
+}
+
+/* Copies element i of v to element j of r, which is of its type or wider. */
+static void copy_elem(Value r, size_t j, Value v, size_t i)
+{
+	if (r->vec_type == FLOAT) {
+		floats(r)[j] = float_at(v, i);
+	} else if (r->vec_type == BOOLEAN) {
+		bits(r)[j / WORD_BITS] |= get_bit(v, i) << (j % WORD_BITS);
+	} else {
+		ints(r)[j] = v->vec_type == BOOLEAN ? (long)get_bit(v, i) : ints(v)[i];
+	}
+}
+
+/* Rows and columns of the tiles the generic f.g works in. */
+#define FOLD_TILE 64
+
+/* The narrowest type holding both a's and b's elements. */
+static enum type wider(enum type a, enum type b)
+{
+	if (a == FLOAT || b == FLOAT) {
+		return FLOAT;
+	}
+	return a == INTEGER || b == INTEGER ? INTEGER : BOOLEAN;
+}
+
+/*
+ * f/ of g between row i of a and columns j0 to j0 + cols of w, a tile of
+ * FOLD_TILE along k at a time. f/ folds from the right, so tiles are taken
+ * from the last, and each is reduced with the fold of those after it as its
+ * last column: f/ x0 x1 … acc is x0 f x1 f … acc.
+*/
+static Value inner_tile(Value a, Value w, Value (*reduce)(Value),
+		Value (*g)(Value, Value), size_t i, size_t j0, size_t cols, size_t k,
+		size_t m)
+{
+	Value acc = NULL;
+	/* At least one tile, so that for k = 0 f/ gives its identities. */
+	for (size_t p0 = k ? (k - 1) / FOLD_TILE * FOLD_TILE : 0; ;
+			p0 -= FOLD_TILE) {
+		const size_t len = k - p0 < FOLD_TILE ? k - p0 : FOLD_TILE;
+		const size_t width = len + (acc != NULL);
+		const unsigned long shape[2] = { cols, width };
+		Value x = make_value(a->vec_type, 2, shape, cols * len);
+		Value y = make_value(w->vec_type, 2, shape, cols * len);
+		Value z;
+		for (size_t j = 0; j < cols; ++j) {
+			for (size_t p = 0; p < len; ++p) {
+				copy_elem(x, j * len + p, a, i * k + p0 + p);
+				copy_elem(y, j * len + p, w, (p0 + p) * m + j0 + j);
+			}
+		}
+		x->sd[1] = y->sd[1] = len;
+		z = g(x, y);
+		value_free(x);
+		value_free(y);
+		if (acc) { /* Append the fold so far as the last column. */
+			Value zz = make_value(wider(z->vec_type, acc->vec_type), 2,
+				shape, cols * width);
+			for (size_t j = 0; j < cols; ++j) {
+				for (size_t p = 0; p < len; ++p) {
+					copy_elem(zz, j * width + p, z, j * len + p);
+				}
+				copy_elem(zz, j * width + len, acc, j);
+			}
+			value_free(z);
+			value_free(acc);
+			z = zz;
+		}
+		acc = reduce(z);
+		value_free(z);
+		if (p0 == 0) {
+			return acc;
+		}
+	}
+}
+
+/*
+ * ⍺f.g⍵ for any f with a reduction and any scalar g, a tile of FOLD_TILE
+ * result columns at a time, so the temporaries are at most a tile.
+*/
+static Value inner_rows(Value a, Value w, Value (*reduce)(Value),
+		Value (*g)(Value, Value), size_t n, size_t k, size_t m,
+		unsigned long rank)
+{
+	const size_t tiles = (m + FOLD_TILE - 1) / FOLD_TILE;
+	Value* folds = mem_alloc(sizeof *folds * (n * tiles > 0 ? n * tiles : 1));
+	enum type t = BOOLEAN;
+	Value r;
+	assert(folds); /* TODO: Error handling */
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t b = 0; b < tiles; ++b) {
+			const size_t j0 = b * FOLD_TILE;
+			Value f = inner_tile(a, w, reduce, g, i, j0,
+				m - j0 < FOLD_TILE ? m - j0 : FOLD_TILE, k, m);
+			t = wider(t, f->vec_type);
+			folds[i * tiles + b] = f;
+		}
+	}
+	r = make_value(t, rank, NULL, n * m);
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t j = 0; j < m; ++j) {
+			copy_elem(r, i * m + j, folds[i * tiles + j / FOLD_TILE],
+				j % FOLD_TILE);
+		}
+	}
+	for (size_t f = 0; f < n * tiles; ++f) {
+		value_free(folds[f]);
+	}
+	mem_dealloc(folds);
+	return r;
+}
+
+Value value_inner(Value a, Value w, Value (*f)(Value, Value),
+		Value (*reduce)(Value), Value (*g)(Value, Value))
+{
+	struct Value_ ab, wb;
+	size_t n = 1, m = 1, k;
+	unsigned long rank;
+	Value r;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	if (!a->rank || !w->rank) {
+		fprintf(stdout, "Error: rank error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	k = a->sd[a->rank - 1];
+	if (w->sd[0] != k) {
+		fprintf(stdout, "Error: mismatched shapes.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	for (unsigned long d = 0; d + 1 < a->rank; ++d) {
+		n *= a->sd[d];
+	}
+	for (unsigned long d = 1; d < w->rank; ++d) {
+		m *= w->sd[d];
+	}
+	rank = a->rank + w->rank - 2;
+	r = f == value_add && g == value_times ? matmul(a, w, n, k, m, rank)
+		: inner_rows(a, w, reduce, g, n, k, m, rank);
+	memcpy(r->sd, a->sd, sizeof a->sd[0] * (a->rank - 1));
+	memcpy(r->sd + a->rank - 1, w->sd + 1, sizeof w->sd[0] * (w->rank - 1));
+	return r;
+}
+
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+/* Built for the popcnt instruction, and only called if the CPU has it. */
+__attribute__((target("popcnt")))
+static size_t count_words_popcnt(const unsigned long* w, size_t n)
+{
+	size_t count = 0;
+	for (size_t k = 0; k < n; ++k) {
+		count += (size_t)__builtin_popcountl(w[k]);
+	}
+	return count;
+}
+#endif
+
+static size_t count_words(const unsigned long* w, size_t n)
+{
+	size_t count = 0;
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+	if (__builtin_cpu_supports("popcnt")) {
+		return count_words_popcnt(w, n);
+	}
+#endif
+	for (size_t k = 0; k < n; ++k) {
+		count += (size_t)__builtin_popcountl(w[k]);
+	}
+	return count;
+}
+
+/* Set bits among the n starting at bit from, which needn't be aligned. */
+static size_t count_bits(const unsigned long* w, size_t from, size_t n)
+{
+	size_t count = 0;
+	const size_t lo = from % WORD_BITS;
+	w += from / WORD_BITS;
+	if (lo && n) {
+		const size_t m = n < WORD_BITS - lo ? n : WORD_BITS - lo;
+		count += (size_t)__builtin_popcountl(*w++ >> lo & low_mask(m));
+		n -= m;
+	}
+	count += count_words(w, n / WORD_BITS);
+	w += n / WORD_BITS;
+	if (n % WORD_BITS) {
+		count += (size_t)__builtin_popcountl(*w & low_mask(n % WORD_BITS));
+	}
+	return count;
+}
+
+/* ∧/ (all, with any unset) or ∨/ (any) along the last axis. */
+static Value fold_bits(Value v, int any)
+{
+	struct Value_ box;
+	Value b = as_bools(unbox(v, &box));
+	const size_t len = b->rank ? b->sd[b->rank - 1] : 1;
+	const unsigned long rank = b->rank ? b->rank - 1 : 0;
+	size_t rows = 1;
+	Value r;
+	for (unsigned long d = 0; d < rank; ++d) {
+		rows *= b->sd[d];
+	}
+	r = make_value(BOOLEAN, rank, b->sd, rows);
+	for (size_t i = 0; i < rows; ++i) {
+		const size_t set = count_bits(bits(b), i * len, len);
+		const unsigned long x = any ? set != 0 : set == len;
+		bits(r)[i / WORD_BITS] |= x << (i % WORD_BITS);
+	}
+	value_free(b);
+	return r;
+}
+
+Value value_all(Value v)
+{
+	return fold_bits(v, 0);
+}
+
+Value value_any(Value v)
+{
+	return fold_bits(v, 1);
+}
+
+/*
+ * ⍺/⍵: the elements of each row of w whose bit in the mask a is set. A
+ * single bit keeps or drops every element, and a scalar w is repeated.
+*/
+Value value_compress(Value a, Value w)
+{
+	struct Value_ ab, wb;
+	Value m, r;
+	unsigned long rank;
+	size_t len, rows = 1, kept = 0;
+	size_t* idx;
+	m = as_bools(unbox(a, &ab));
+	w = unbox(w, &wb);
+	rank = w->rank ? w->rank : 1;
+	len = w->rank ? w->sd[w->rank - 1] : m->ecount;
+	if (m->rank > 1 || (m->ecount != len && m->ecount != 1)) {
+		fprintf(stdout, "Error: mismatched shapes.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	for (unsigned long d = 0; d + 1 < w->rank; ++d) {
+		rows *= w->sd[d];
+	}
+	/* The positions kept in each row, found a set bit at a time. */
+	idx = mem_alloc(sizeof *idx * (len ? len : 1));
+	assert(idx); /* TODO: Error handling */
+	if (m->ecount == 1) {
+		for (; get_bit(m, 0) && kept < len; ++kept) {
+			idx[kept] = kept;
+		}
+	} else {
+		for (size_t k = 0; k < words(len); ++k) {
+			for (unsigned long word = bits(m)[k]; word; word &= word - 1) {
+				idx[kept++] = k * WORD_BITS + (size_t)__builtin_ctzl(word);
+			}
+		}
+	}
+	r = make_value(w->vec_type, rank, w->rank ? w->sd : &kept, rows * kept);
+	r->sd[rank - 1] = kept;
+	for (size_t i = 0, o = 0; i < rows; ++i) {
+		unsigned long* to = data_of(r);
+		const unsigned long* from = data_of(w);
+		for (size_t k = 0; k < kept; ++k, ++o) {
+			const size_t at = w->rank ? i * len + idx[k] : 0;
+			if (w->vec_type == BOOLEAN) {
+				to[o / WORD_BITS] |= get_bit(w, at) << (o % WORD_BITS);
+			} else { /* Longs and doubles are both a word. */
+				to[o] = from[at];
+			}
+		}
+	}
+	mem_dealloc(idx);
+	value_free(m);
+	return r;
+}
+
+/* A view of rank and ecount, sharing x's elements from offset on. */
+static Value make_view(Value x, unsigned long rank, size_t ecount,
+		size_t offset)
+{
+	Value v = mem_alloc(sizeof *v + sizeof(unsigned long) * rank);
+	assert(v); /* TODO: Error handling */
+	v->refcount = 1;
+	v->type = rank ? VECTOR : INTEGER;
+	v->rank = rank;
+	v->ecount = ecount;
+	v->acount = ecount;
+	v->vec_type = x->vec_type;
+	if (x->base) { /* Views of views share the original. */
+		v->base = value_reference(x->base);
+		v->offset = x->offset + offset;
+	} else {
+		v->base = value_reference(x);
+		v->offset = offset;
+	}
+	return v;
+}
+
+/* Whether the n indices in k are consecutive, ascending. */
+static int consecutive(const long* k, size_t n)
+{
+	unsigned long gaps = 0;
+	for (size_t j = 1; j < n; ++j) {
+		gaps |= (unsigned long)(k[j] - k[j - 1] - 1);
+	}
+	return !gaps;
+}
+
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+/* Built for AVX2's gather, and only called if the CPU has it. */
+__attribute__((target("avx2")))
+static void gather_avx2(unsigned long* r, const unsigned long* x,
+		const long* k, size_t n)
+{
+	const __m256i one = _mm256_set1_epi64x(1);
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		const __m256i at = _mm256_sub_epi64(
+			_mm256_loadu_si256((const __m256i*)&k[j]), one);
+		_mm256_storeu_si256((__m256i*)&r[j],
+			_mm256_i64gather_epi64((const long long*)x, at, 8));
+	}
+	for (; j < n; ++j) {
+		r[j] = x[k[j] - 1];
+	}
+}
+#endif
+
+/* r[j] = x[k[j] - 1] for the n (checked) indices in k, which count from 1. */
+static void gather(unsigned long* r, const unsigned long* x, const long* k,
+		size_t n)
+{
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+	if (__builtin_cpu_supports("avx2")) {
+		gather_avx2(r, x, k, n);
+		return;
+	}
+#endif
+	for (size_t j = 0; j < n; ++j) {
+		r[j] = x[k[j] - 1];
+	}
+}
+
+/*
+ * x[i]: the major cells of x at indices i, counting from 1. The result has
+ * i's shape followed by a cell's. Consecutive indices into integers or
+ * floats give a view sharing x's elements rather than a copy.
+*/
+Value value_index(Value x, Value i)
+{
+	struct Value_ xb, ib;
+	Value idx, r;
+	size_t n, cell;
+	long lo = LONG_MAX, hi = LONG_MIN;
+	const long* k;
+	x = unbox(x, &xb);
+	i = unbox(i, &ib);
+	if (x->rank == 0) {
+		fprintf(stdout, "Error: rank error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	idx = value_widen(i);
+	if (idx->vec_type != INTEGER) {
+		fprintf(stdout, "Error: domain error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	n = x->sd[0];
+	cell = n ? x->ecount / n : 0;
+	k = ints(idx);
+	for (size_t j = 0; j < idx->ecount; ++j) { /* Branch free, so it vectorizes. */
+		lo = k[j] < lo ? k[j] : lo;
+		hi = k[j] > hi ? k[j] : hi;
+	}
+	if (idx->ecount && (lo < 1 || (unsigned long)hi > n)) {
+		fprintf(stdout, "Error: index error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	if (x->vec_type != BOOLEAN && idx->ecount * cell >= VIEW_MIN
+			&& consecutive(k, idx->ecount)) {
+		r = make_view(x, idx->rank + x->rank - 1, idx->ecount * cell,
+			(size_t)(k[0] - 1) * cell);
+	} else {
+		r = make_value(x->vec_type, idx->rank + x->rank - 1, NULL,
+			idx->ecount * cell);
+		if (x->vec_type == BOOLEAN) {
+			for (size_t j = 0, o = 0; j < idx->ecount; ++j) {
+				for (size_t c = 0; c < cell; ++c, ++o) {
+					const size_t at = (size_t)(k[j] - 1) * cell + c;
+					bits(r)[o / WORD_BITS] |= get_bit(x, at) << (o % WORD_BITS);
+				}
+			}
+		} else if (cell == 1) {
+			gather(data_of(r), data_of(x), k, idx->ecount);
+		} else {
+			for (size_t j = 0; j < idx->ecount; ++j) {
+				memcpy(data_of(r) + j * cell, data_of(x) + (k[j] - 1) * cell,
+					sizeof(unsigned long) * cell);
+			}
+		}
+	}
+	memcpy(r->sd, idx->sd, sizeof r->sd[0] * idx->rank);
+	memcpy(r->sd + idx->rank, x->sd + 1, sizeof r->sd[0] * (x->rank - 1));
+	value_free(idx);
+	return r;
+}
+
+/* ⍳n: the integers 1 to n. */
+Value value_iota(Value v)
+{
+	struct Value_ box;
+	Value r;
+	long n;
+	v = unbox(v, &box);
+	if (v->rank > 1 || v->ecount != 1 || v->vec_type == FLOAT) {
+		fprintf(stdout, "Error: domain error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	n = v->vec_type == BOOLEAN ? (long)get_bit(v, 0) : ints(v)[0];
+	if (n < 0) {
+		fprintf(stdout, "Error: domain error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	r = value_make_ints((size_t)n);
+	for (long j = 0; j < n; ++j) {
+		ints(r)[j] = j + 1;
+	}
+	return r;
+}
+
+/*
+ * Sort keys: unsigned words in the order of v's elements (reversed, if
+ * down), so that sorting them as unsigned sorts the elements.
+*/
+static unsigned long* sort_keys_of(Value v, int down)
+{
+	const unsigned long sign = 1UL << (WORD_BITS - 1);
+	const unsigned long flip = down ? ~0UL : 0;
+	unsigned long* keys = mem_alloc(sizeof *keys * (v->ecount ? v->ecount : 1));
+	const unsigned long* d;
+	assert(keys); /* TODO: Error handling */
+	if (v->vec_type == BOOLEAN) {
+		for (size_t i = 0; i < v->ecount; ++i) {
+			keys[i] = get_bit(v, i) ^ flip;
+		}
+		return keys;
+	}
+	d = data_of(v);
+	for (size_t i = 0; i < v->ecount; ++i) {
+		/* Negative doubles order backwards by their bits, so flip all. */
+		const unsigned long neg = v->vec_type == FLOAT && d[i] & sign ? ~0UL : 0;
+		keys[i] = (d[i] ^ (neg | sign)) ^ flip;
+	}
+	return keys;
+}
+
+static Value grade(Value v, int down)
+{
+	struct Value_ box;
+	Value r;
+	unsigned long* keys;
+	v = unbox(v, &box);
+	if (v->rank != 1) {
+		fprintf(stdout, "Error: rank error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	keys = sort_keys_of(v, down);
+	r = value_make_ints(v->ecount);
+	for (size_t i = 0; i < v->ecount; ++i) {
+		ints(r)[i] = (long)i + 1;
+	}
+	sort_keys(keys, (unsigned long*)ints(r), v->ecount);
+	mem_dealloc(keys);
+	return r;
+}
+
+Value value_grade_up(Value v)
+{
+	return grade(v, 0);
+}
+
+Value value_grade_down(Value v)
+{
+	return grade(v, 1);
+}
+
+/* v[⍋v], or v[⍒v] if down, sorting the elements without a permutation. */
+Value value_sort(Value v, int down)
+{
+	const unsigned long sign = 1UL << (WORD_BITS - 1);
+	const unsigned long flip = down ? ~0UL : 0;
+	struct Value_ box;
+	unsigned long* keys;
+	Value r;
+	v = unbox(v, &box);
+	if (v->rank != 1) {
+		fprintf(stdout, "Error: rank error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+	keys = sort_keys_of(v, down);
+	sort_keys(keys, NULL, v->ecount);
+	r = copy_value_container(v, v->vec_type);
+	if (v->vec_type == BOOLEAN) {
+		for (size_t i = 0; i < r->ecount; ++i) {
+			bits(r)[i / WORD_BITS] |= (keys[i] ^ flip) << (i % WORD_BITS);
+		}
+	} else {
+		unsigned long* d = data_of(r);
+		for (size_t i = 0; i < r->ecount; ++i) { /* Undo sort_keys_of(). */
+			const unsigned long k = keys[i] ^ flip;
+			const unsigned long neg = v->vec_type == FLOAT && !(k & sign)
+				? ~0UL : 0;
+			d[i] = k ^ (neg | sign);
+		}
+	}
+	mem_dealloc(keys);
+	return r;
+}
+
+/*
+ * Search keys: words equal exactly when v's elements are. With as_floats,
+ * elements are compared as doubles (-0 as 0), so 2 finds 2.0.
+*/
+static unsigned long* search_keys(Value v, int as_floats)
+{
+	const unsigned long sign = 1UL << (WORD_BITS - 1);
+	unsigned long* keys = mem_alloc(sizeof *keys * (v->ecount ? v->ecount : 1));
+	assert(keys); /* TODO: Error handling */
+	if (as_floats) {
+		for (size_t i = 0; i < v->ecount; ++i) {
+			const double d = float_at(v, i) + 0.0; /* -0 + 0 is 0. */
+			memcpy(&keys[i], &d, sizeof d);
+		}
+	} else if (v->vec_type == BOOLEAN) {
+		for (size_t i = 0; i < v->ecount; ++i) {
+			keys[i] = get_bit(v, i) ^ sign;
+		}
+	} else { /* In signed order, so small ranges about 0 stay dense. */
+		const unsigned long* d = data_of(v);
+		for (size_t i = 0; i < v->ecount; ++i) {
+			keys[i] = d[i] ^ sign;
+		}
+	}
+	return keys;
+}
+
+static void check_vector(Value v)
+{
+	if (v->rank != 1) {
+		fprintf(stdout, "Error: rank error.\n");
+		exit(EXIT_FAILURE); /* TODO: Error handling */
+	}
+}
+
+Value value_index_of(Value a, Value w)
+{
+	struct Value_ ab, wb;
+	int as_floats;
+	unsigned long* ka, *kw;
+	struct Hash* h;
+	Value r;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	as_floats = a->vec_type == FLOAT || w->vec_type == FLOAT;
+	check_vector(a);
+	ka = search_keys(a, as_floats);
+	kw = search_keys(w, as_floats);
+	h = hash_make(ka, a->ecount, 1);
+	r = copy_value_container(w, INTEGER);
+	hash_find(h, kw, w->ecount, data_of(r));
+	for (size_t i = 0; i < r->ecount; ++i) { /* Counting from 1. */
+		ints(r)[i] += 1;
+	}
+	hash_free(h);
+	mem_dealloc(kw);
+	mem_dealloc(ka);
+	return r;
+}
+
+Value value_member(Value a, Value w)
+{
+	struct Value_ ab, wb;
+	int as_floats;
+	unsigned long* ka, *kw;
+	struct Hash* h;
+	Value r;
+	a = unbox(a, &ab);
+	w = unbox(w, &wb);
+	as_floats = a->vec_type == FLOAT || w->vec_type == FLOAT;
+	ka = search_keys(a, as_floats);
+	kw = search_keys(w, as_floats);
+	h = hash_make(kw, w->ecount, 0);
+	r = copy_value_container(a, BOOLEAN);
+	hash_member(h, ka, a->ecount, bits(r));
+	hash_free(h);
+	mem_dealloc(kw);
+	mem_dealloc(ka);
+	return r;
+}
+
+Value value_unique(Value v)
+{
+	struct Value_ box;
+	unsigned long* keys;
+	struct Hash* h;
+	size_t* firsts;
+	size_t count;
+	Value r;
+	if (!IMMEDIATE(v) && v->rank == 1 && !v->ecount) {
+		return value_reference(v); /* Already unique, and nothing to hash. */
+	}
+	v = unbox(v, &box);
+	if (v->rank > 1) {
+		check_vector(v);
+	}
+	keys = search_keys(v, 0);
+	h = hash_make(keys, v->ecount, 1);
+	firsts = mem_alloc(sizeof *firsts * v->ecount);
+	assert(firsts); /* TODO: Error handling */
+	count = hash_firsts(h, firsts);
+	r = make_value(v->vec_type, 1, &count, count);
+	if (v->vec_type == BOOLEAN) {
+		for (size_t i = 0; i < count; ++i) {
+			bits(r)[i / WORD_BITS] |= get_bit(v, firsts[i]) << (i % WORD_BITS);
+		}
+	} else {
+		unsigned long* to = data_of(r);
+		const unsigned long* from = data_of(v);
+		for (size_t i = 0; i < count; ++i) {
+			to[i] = from[firsts[i]];
+		}
+	}
+	mem_dealloc(firsts);
+	hash_free(h);
+	mem_dealloc(keys);
+	return r;
+}
+
+/* Sums each row of integers; nonzero if the sum overflowed. */
+static int sum_ints(long* r, const long* a, size_t n)
+{
+	unsigned long ovf = 0, s = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const unsigned long t = s + (unsigned long)a[i];
+		ovf |= (s ^ t) & ((unsigned long)a[i] ^ t);
+		s = t;
+	}
+	*r = (long)s;
+	return (long)ovf < 0;
+}
+
+/* +/ along the last axis. Rows promote to floats as in value_add(). */
+Value value_sum(Value v)
+{
+	struct Value_ box;
+	size_t len, rows = 1, i = 0;
+	unsigned long rank;
+	v = unbox(v, &box);
+	len = v->rank ? v->sd[v->rank - 1] : 1;
+	rank = v->rank ? v->rank - 1 : 0;
+	for (unsigned long d = 0; d < rank; ++d) {
+		rows *= v->sd[d];
+	}
+	Value r = make_value(FLOAT, rank, v->sd, rows);
+	r->vec_type = INTEGER;
+	if (v->vec_type == BOOLEAN) { /* Counts set bits, which can't overflow. */
+		for (; i < rows; ++i) {
+			ints(r)[i] = (long)count_bits(bits(v), i * len, len);
+		}
+		return r;
+	}
+	if (v->vec_type == INTEGER) {
+		for (; i < rows; ++i) {
+			if (sum_ints(&ints(r)[i], &ints(v)[i * len], len)) {
+				widen_ints(data_of(r), i);
+				break;
+			}
+		}
+		if (i == rows) {
+			return r;
+		}
+	}
+	r->vec_type = FLOAT;
+	for (; i < rows; ++i) {
+		double s = 0;
+		for (size_t j = 0; j < len; ++j) {
+			s += float_at(v, i * len + j);
+		}
+		floats(r)[i] = s;
+	}
+	return r;
+}
+
+/*
+ * f/ along the last axis. Rows of integers stay integral until one fails,
+ * then the rest are folded in doubles, as in dyadic().
+*/
+static Value reduce(Value v, const struct reduction* k)
+{
+	struct Value_ box;
+	size_t len, rows = 1, i = 0;
+	unsigned long rank;
+	Value r;
+	v = unbox(v, &box);
+	if (v->vec_type == BOOLEAN) {
+		Value wv = value_widen(v);
+		r = reduce(wv, k);
+		value_free(wv);
+		return r;
+	}
+	len = v->rank ? v->sd[v->rank - 1] : 1;
+	rank = v->rank ? v->rank - 1 : 0;
+	for (unsigned long d = 0; d < rank; ++d) {
+		rows *= v->sd[d];
+	}
+	r = make_value(FLOAT, rank, v->sd, rows);
+	r->vec_type = INTEGER;
+	if (len == 0) { /* Every row is empty. */
+		if (k->ints && k->identity == floor(k->identity)
+				&& fabs(k->identity) <= IMMEDIATE_MAX) {
+			for (; i < rows; ++i) {
+				ints(r)[i] = (long)k->identity;
+			}
+		} else {
+			r->vec_type = FLOAT;
+			for (; i < rows; ++i) {
+				floats(r)[i] = k->identity;
+			}
+		}
+		return r;
+	}
+	if (v->vec_type == INTEGER && k->ints) {
+		for (; i < rows; ++i) {
+			if (k->ints(&ints(r)[i], &ints(v)[i * len], len)) {
+				widen_ints(data_of(r), i);
+				break;
+			}
+		}
+		if (i == rows) {
+			return r;
+		}
+	}
+	r->vec_type = FLOAT;
+	for (; i < rows; ++i) {
+		floats(r)[i] = k->floats[v->vec_type == FLOAT](elems_from(v, i * len),
+			len);
+	}
+	return r;
+}
+
+Value value_reduce_subtract(Value v)
+{
+	return reduce(v, &sub_reduction);
+}
+
+Value value_reduce_times(Value v)
+{
+	return reduce(v, &mul_reduction);
+}
+
+Value value_reduce_divide(Value v)
+{
+	return reduce(v, &div_reduction);
+}
+
+Value value_reduce_max(Value v)
+{
+	return reduce(v, &max_reduction);
+}
+
+Value value_reduce_min(Value v)
+{
+	return reduce(v, &min_reduction);
+}
+
+Value value_reduce_residue(Value v)
+{
+	return reduce(v, &res_reduction);
+}
+
+Value value_reduce_power(Value v)
+{
+	return reduce(v, &pow_reduction);
+}
+
+unsigned long value_rank(Value v)
+{
+	return IMMEDIATE(v) ? 0 : v->rank;
+}
+
+size_t value_count(Value v)
+{
+	return IMMEDIATE(v) ? 1 : v->ecount;
+}
+
+int value_is_float(Value v)
+{
+	return !IMMEDIATE(v) && v->vec_type == FLOAT;
+}
+
+int value_is_bool(Value v)
+{
+	return !IMMEDIATE(v) && v->vec_type == BOOLEAN;
+}
+
+void* value_data(Value v)
+{
+	assert(!IMMEDIATE(v)); /* Its element is in the handle. */
+	return data_of(v);
+}
+
+long value_scalar(Value v)
+{
+	struct Value_ box;
+	v = unbox(v, &box);
+	assert(v->rank == 0 && v->vec_type == INTEGER);
+	return ints(v)[0];
+}
+
+size_t value_bytes(Value v)
+{
+	if (IMMEDIATE(v)) {
+		return 0;
+	}
+	if (v->base) { /* A view keeps the whole of its base alive. */
+		return sizeof *v + sizeof(unsigned long) * v->rank
+			+ value_bytes(v->base);
+	}
+	return sizeof *v + data_size(v->vec_type, v->rank, v->ecount);
+}
+
+Value value_reference(Value v)
+{
+	if (!IMMEDIATE(v) && v->refcount != PINNED) {
+		v->refcount++;
+	}
+	return v;
+}
+
+/* Bytes of v that matter: its fields, shape and elements, without slack. */
+static size_t block_size(Value v)
+{
+	return offsetof(struct Value_, sd)
+		+ data_size(v->vec_type, v->rank, v->ecount);
+}
+
+size_t value_image_bytes(Value v)
+{
+	struct Value_ box;
+	return block_size(unbox(v, &box));
+}
+
+/* The block holds no pointers, so it is valid wherever it's mapped. */
+int value_write(Value v, FILE* out)
+{
+	struct Value_ box, head;
+	const size_t fixed = offsetof(struct Value_, sd);
+	size_t data;
+	v = unbox(v, &box);
+	data = block_size(v) - fixed - sizeof v->sd[0] * v->rank;
+	memset(&head, 0, sizeof head); /* Padding too, so images are repeatable. */
+	head.refcount = PINNED;
+	head.type = v->type;
+	head.vec_type = v->vec_type;
+	head.ecount = v->ecount;
+	head.acount = v->ecount;
+	head.rank = v->rank; /* Views are written out whole, with no base. */
+	if (fwrite(&head, 1, fixed, out) != fixed
+			|| fwrite(v->sd, sizeof v->sd[0], v->rank, out) != v->rank
+			|| fwrite(data_of(v), 1, data, out) != data) {
+		return -1;
+	}
+	return 0;
+}
+
+Value value_map(const void* p, size_t len)
+{
+	const struct Value_* v = p;
+	unsigned long count = 1;
+	const size_t word = sizeof(unsigned long);
+	const size_t fixed = offsetof(struct Value_, sd);
+	/* The shape must lie within len before it's read. */
+	if (len < fixed || v->refcount != PINNED
+			|| v->base || v->offset
+			|| (v->vec_type != INTEGER && v->vec_type != FLOAT
+				&& v->vec_type != BOOLEAN)
+			|| v->rank > (len - fixed) / word
+			|| v->ecount > len / word * WORD_BITS) {
+		return NULL;
+	}
+	for (unsigned long d = 0; d < v->rank; ++d) {
+		if (__builtin_mul_overflow(count, v->sd[d], &count)) {
+			return NULL;
+		}
+	}
+	if (count != v->ecount || block_size((Value)v) > len) {
+		return NULL;
+	}
+	return (Value)v; /* Never written to, as it's pinned. */
 }
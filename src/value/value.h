@@ -2,18 +2,126 @@
 #define VALUE_H_
 
 #include <assert.h>		/* assert() */
+#include <float.h>		/* DBL_MAX */
+#include <limits.h>		/* CHAR_BIT */
+#include <math.h>		/* floor(), pow() */
+#include <stddef.h>		/* offsetof() */
+#include <stdint.h>		/* SIZE_MAX */
 #include <stdio.h>		/* snprintf() */
 #include <string.h>		/* memcpy() */
 #include "mem/mem.h"	/* mem_alloc(), mem_free() */
+#include "sort/sort.h"	/* sort_keys() */
+#include "hash/hash.h"	/* hash_make(), hash_find() */
+#include "pool/pool.h"	/* pool_run() */
 
+/*
+ * A handle to an array. Small integer scalars are held in the handle itself,
+ * so making, referencing and freeing them never touches the heap.
+*/
 typedef struct Value_* Value;
 
 enum value_type { VALUE_NUMBER, VALUE_VECTOR };
 Value value_make_number(unsigned long value);
-Value value_make_vector(unsigned long value);
-Value value_append(Value v, unsigned long val);
+Value value_make_vector(const unsigned long* elems, size_t count);
+Value value_make_ints(size_t count); /* Vector, elements uninitialized. */
+void value_truncate(Value v, size_t count);
+/*
+ * Scalar arithmetic. Integer results are exact, and become doubles where
+ * they'd overflow or aren't whole (as for ÷, or * with a negative power).
+*/
 Value value_add(Value a, Value w);
+Value value_subtract(Value a, Value w);
+Value value_times(Value a, Value w); /* × */
+Value value_divide(Value a, Value w); /* ÷ */
+Value value_max(Value a, Value w); /* ⌈ */
+Value value_min(Value a, Value w); /* ⌊ */
+Value value_residue(Value a, Value w); /* ⍺|⍵: ⍵ modulo ⍺. */
+Value value_power(Value a, Value w); /* * */
+Value value_negate(Value v);
+Value value_signum(Value v); /* ×⍵ */
+Value value_reciprocal(Value v); /* ÷⍵ */
+Value value_ceiling(Value v);
+Value value_floor(Value v);
+Value value_magnitude(Value v); /* |⍵ */
+Value value_exp(Value v); /* *⍵ */
+Value value_sum(Value v); /* +/ */
+/*
+ * Reductions along the last axis, folding each row from the right. An empty
+ * row gives the dyad's identity; ⌈/ and ⌊/ take the most negative and most
+ * positive floats for that.
+*/
+Value value_reduce_subtract(Value v); /* -/ */
+Value value_reduce_times(Value v); /* ×/ */
+Value value_reduce_divide(Value v); /* ÷/ */
+Value value_reduce_max(Value v); /* ⌈/ */
+Value value_reduce_min(Value v); /* ⌊/ */
+Value value_reduce_residue(Value v); /* |/ */
+Value value_reduce_power(Value v); /* Reduction by *. */
+
+/* Comparisons, giving booleans packed 64 to a word. */
+Value value_equal(Value a, Value w);
+Value value_not_equal(Value a, Value w);
+Value value_less(Value a, Value w);
+Value value_less_equal(Value a, Value w);
+Value value_greater(Value a, Value w);
+Value value_greater_equal(Value a, Value w);
+/* Boolean ∧ ∨ ~, and their reductions. Integers must be 0 or 1. */
+Value value_and(Value a, Value w);
+Value value_or(Value a, Value w);
+Value value_not(Value v);
+Value value_all(Value v); /* ∧/ */
+Value value_any(Value v); /* ∨/ */
+Value value_compress(Value a, Value w); /* ⍺/⍵, with ⍺ a boolean mask. */
+Value value_widen(Value v); /* Booleans as integers; others referenced. */
+/*
+ * ⍺∘.f⍵: f between every element of a and every element of w, shaped a's
+ * shape then w's. f is one of the scalar dyads above.
+*/
+Value value_outer(Value a, Value w, Value (*f)(Value, Value));
+/*
+ * ⍺f.g⍵, along a's last axis and w's first, for f with a reduction (given as
+ * reduce) and a scalar dyad g. +.× is matrix multiplication.
+*/
+Value value_inner(Value a, Value w, Value (*f)(Value, Value),
+	Value (*reduce)(Value), Value (*g)(Value, Value));
+/*
+ * x[i], counting from 1. Runs of consecutive cells are views that share
+ * x's elements (and keep x alive); other selections are gathered.
+*/
+Value value_index(Value x, Value i);
+Value value_iota(Value v); /* ⍳n */
+/* ⍋ and ⍒: the stable permutation, counting from 1, sorting v up or down. */
+Value value_grade_up(Value v);
+Value value_grade_down(Value v);
+Value value_sort(Value v, int down); /* v[⍋v], or v[⍒v] if down. */
+/* ⍺⍳⍵: where each element of w first occurs in the vector a, counting from
+ * 1, or 1 + ≢a where it doesn't. */
+Value value_index_of(Value a, Value w);
+Value value_member(Value a, Value w); /* ⍺∊⍵ */
+Value value_unique(Value v); /* ∪⍵, in order of first occurrence. */
+
 Value value_reference(Value v);
+
+/*
+ * Images. value_write() stores v as a self-contained block of
+ * value_image_bytes(v) bytes, and value_map() uses such a block in place
+ * (typically mapped from a file) without copying it, returning NULL if p
+ * doesn't hold a whole, valid one. Mapped Values are pinned: references
+ * aren't counted and they're never freed, so the block must outlive them.
+*/
+size_t value_image_bytes(Value v);
+int value_write(Value v, FILE* out); /* Returns nonzero on error. */
+Value value_map(const void* p, size_t len);
+/* Memory held by v. A view counts all of its base, which it keeps alive. */
+size_t value_bytes(Value v);
+unsigned long value_rank(Value v);
+size_t value_count(Value v); /* Number of elements. */
+int value_is_float(Value v);
+int value_is_bool(Value v);
+/* Elements, as long or double by type, or bits packed into unsigned longs.
+ * Not for scalar integers, which may have no storage; see value_scalar(). */
+void* value_data(Value v);
+long value_scalar(Value v); /* The element of a scalar integer. */
 void value_free(Value v);
 char* value_stringify(Value v);
 #endif
@@ -0,0 +1,345 @@
+#define _POSIX_C_SOURCE 200809L /* fileno(), fsync() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
+#include <sys/mman.h>		/* mmap(), munmap() */
+#include <sys/stat.h>		/* fstat() */
+#include <unistd.h>			/* close() */
+#include "ws.h"
+
+struct Workspace {
+	size_t count; /* Symbols interned. */
+	size_t cap;
+	char** names;
+	Value* values; /* Bound to each symbol, or NULL. */
+	uint64_t* versions; /* clock when each was last bound. */
+	uint64_t clock;
+	uint32_t* table; /* Open addressing: symbol + 1, or 0 if empty. */
+	size_t table_cap; /* Power of two, over twice count. */
+	void* image; /* Mapping the values may point into, or NULL. */
+	size_t image_len;
+};
+
+/*
+ * An image is a header, a table of symbols, their names (each NUL
+ * terminated, in symbol order), then the bound Values' blocks. Every offset
+ * is from the start of the file. Blocks of a page or more start on a page,
+ * so a mapped array's elements share no page with anything else.
+*/
+#define IMAGE_MAGIC "APLWS\0\0\3" /* Version 3: views without strides. */
+#define IMAGE_ORDER 0x01020304u /* Reads differently on the other byte order. */
+#define IMAGE_PAGE 4096
+#define IMAGE_ALIGN 16
+
+struct image_header {
+	char magic[8];
+	uint32_t word_bytes; /* sizeof(long) where it was written. */
+	uint32_t order;
+	uint64_t count; /* Symbols. */
+	uint64_t names; /* Offset of the first name. */
+	uint64_t size; /* Of the whole file. */
+};
+
+struct image_symbol {
+	uint64_t value; /* Offset of the bound Value, or 0 if unbound. */
+	uint64_t bytes;
+};
+
+struct Workspace* ws_make(void)
+{
+	struct Workspace* ws = mem_alloc(sizeof *ws);
+	assert(ws); /* TODO: Error handling */
+	memset(ws, 0, sizeof *ws);
+	return ws;
+}
+
+void ws_free(struct Workspace* ws)
+{
+	if (!ws) {
+		return;
+	}
+	for (size_t i = 0; i < ws->count; ++i) {
+		mem_dealloc(ws->names[i]);
+		if (ws->values[i]) {
+			value_free(ws->values[i]);
+		}
+	}
+	mem_dealloc(ws->names);
+	mem_dealloc(ws->values);
+	mem_dealloc(ws->versions);
+	mem_dealloc(ws->table);
+	if (ws->image) {
+		munmap(ws->image, ws->image_len);
+	}
+	mem_dealloc(ws);
+}
+
+static uint64_t hash_name(const char* name)
+{
+	uint64_t h = 0xCBF29CE484222325ull; /* FNV-1a */
+	for (; *name; ++name) {
+		h = (h ^ (unsigned char)*name) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+/* The table slot holding name, or the empty slot it would go in. */
+static uint32_t* find_slot(struct Workspace* ws, const char* name)
+{
+	const size_t mask = ws->table_cap - 1;
+	for (size_t i = hash_name(name) & mask; ; i = (i + 1) & mask) {
+		uint32_t* slot = &ws->table[i];
+		if (!*slot || !strcmp(ws->names[*slot - 1], name)) {
+			return slot;
+		}
+	}
+}
+
+static void grow(struct Workspace* ws)
+{
+	const size_t cap = ws->cap ? ws->cap * 2 : 16;
+	ws->names = mem_realloc(ws->names, cap * sizeof *ws->names);
+	ws->values = mem_realloc(ws->values, cap * sizeof *ws->values);
+	ws->versions = mem_realloc(ws->versions, cap * sizeof *ws->versions);
+	assert(ws->names && ws->values && ws->versions); /* TODO: Error handling */
+	ws->cap = cap;
+
+	/* Rehash into a table kept under half full. */
+	mem_dealloc(ws->table);
+	ws->table_cap = cap * 2;
+	ws->table = mem_alloc(ws->table_cap * sizeof *ws->table);
+	assert(ws->table); /* TODO: Error handling */
+	memset(ws->table, 0, ws->table_cap * sizeof *ws->table);
+	for (size_t i = 0; i < ws->count; ++i) {
+		*find_slot(ws, ws->names[i]) = (uint32_t)i + 1;
+	}
+}
+
+uint32_t ws_intern(struct Workspace* ws, const char* name)
+{
+	uint32_t* slot;
+	size_t len;
+	if (ws->count == ws->cap) {
+		grow(ws);
+	}
+	slot = find_slot(ws, name);
+	if (*slot) {
+		return *slot - 1;
+	}
+	len = strlen(name) + 1;
+	ws->names[ws->count] = mem_alloc(len);
+	assert(ws->names[ws->count]); /* TODO: Error handling */
+	memcpy(ws->names[ws->count], name, len);
+	ws->values[ws->count] = NULL;
+	ws->versions[ws->count] = 0;
+	*slot = (uint32_t)ws->count + 1;
+	return (uint32_t)ws->count++;
+}
+
+const char* ws_name(struct Workspace* ws, uint32_t sym)
+{
+	assert(sym < ws->count);
+	return ws->names[sym];
+}
+
+size_t ws_count(struct Workspace* ws)
+{
+	return ws->count;
+}
+
+Value ws_get(struct Workspace* ws, uint32_t sym)
+{
+	assert(sym < ws->count);
+	return ws->values[sym];
+}
+
+void ws_set(struct Workspace* ws, uint32_t sym, Value v)
+{
+	assert(sym < ws->count);
+	if (ws->values[sym]) {
+		value_free(ws->values[sym]);
+	}
+	ws->values[sym] = v;
+	ws->versions[sym] = ++ws->clock;
+}
+
+uint64_t ws_version(struct Workspace* ws, uint32_t sym)
+{
+	assert(sym < ws->count);
+	return ws->versions[sym];
+}
+
+static uint64_t align_up(uint64_t off, uint64_t to)
+{
+	return (off + to - 1) / to * to;
+}
+
+/* Where each bound value goes, after the names. Returns the file size. */
+static uint64_t lay_out(struct Workspace* ws, struct image_symbol* syms,
+		uint64_t names)
+{
+	uint64_t off = names;
+	for (size_t i = 0; i < ws->count; ++i) {
+		off += strlen(ws->names[i]) + 1;
+	}
+	for (size_t i = 0; i < ws->count; ++i) {
+		syms[i].value = syms[i].bytes = 0;
+		if (ws->values[i]) {
+			syms[i].bytes = value_image_bytes(ws->values[i]);
+			off = align_up(off,
+				syms[i].bytes >= IMAGE_PAGE ? IMAGE_PAGE : IMAGE_ALIGN);
+			syms[i].value = off;
+			off += syms[i].bytes;
+		}
+	}
+	return off;
+}
+
+static int pad_to(FILE* out, uint64_t* pos, uint64_t off)
+{
+	for (; *pos < off; ++*pos) {
+		if (fputc(0, out) == EOF) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int write_image(struct Workspace* ws, FILE* out)
+{
+	struct image_header h;
+	struct image_symbol* syms = mem_alloc((ws->count + 1) * sizeof *syms);
+	uint64_t pos;
+	int err = 0;
+	assert(syms); /* TODO: Error handling */
+	memcpy(h.magic, IMAGE_MAGIC, sizeof h.magic);
+	h.word_bytes = sizeof(long);
+	h.order = IMAGE_ORDER;
+	h.count = ws->count;
+	h.names = sizeof h + ws->count * sizeof *syms;
+	h.size = lay_out(ws, syms, h.names);
+	err |= fwrite(&h, sizeof h, 1, out) != 1;
+	err |= fwrite(syms, sizeof *syms, ws->count, out) != ws->count;
+	for (size_t i = 0; i < ws->count; ++i) {
+		err |= fputs(ws->names[i], out) == EOF || fputc('\0', out) == EOF;
+	}
+	pos = h.names;
+	for (size_t i = 0; i < ws->count; ++i) {
+		pos += strlen(ws->names[i]) + 1;
+	}
+	for (size_t i = 0; i < ws->count && !err; ++i) {
+		if (ws->values[i]) {
+			err |= pad_to(out, &pos, syms[i].value);
+			err |= value_write(ws->values[i], out);
+			pos += syms[i].bytes;
+		}
+	}
+	mem_dealloc(syms);
+	return err ? -1 : 0;
+}
+
+int ws_save(struct Workspace* ws, const char* path)
+{
+	/* Written beside path and renamed over it, so it's never half written. */
+	char* tmp = mem_alloc(strlen(path) + sizeof ".tmp");
+	FILE* out;
+	int err;
+	assert(tmp); /* TODO: Error handling */
+	strcpy(tmp, path);
+	strcat(tmp, ".tmp");
+	out = fopen(tmp, "wb");
+	if (!out) {
+		mem_dealloc(tmp);
+		return -1;
+	}
+	err = write_image(ws, out);
+	err |= fflush(out) || fsync(fileno(out));
+	if (fclose(out)) {
+		err = -1;
+	}
+	if (!err && rename(tmp, path)) {
+		err = -1;
+	}
+	if (err) {
+		const int saved = errno;
+		remove(tmp);
+		errno = saved;
+	}
+	mem_dealloc(tmp);
+	return err;
+}
+
+/* Binds the symbols of the image mapped at base, of size bytes. */
+static int read_image(struct Workspace* ws, const char* base, uint64_t size)
+{
+	struct image_header h;
+	const char* name;
+	if (size < sizeof h) {
+		return -1;
+	}
+	memcpy(&h, base, sizeof h);
+	if (memcmp(h.magic, IMAGE_MAGIC, sizeof h.magic)
+			|| h.word_bytes != sizeof(long) || h.order != IMAGE_ORDER
+			|| h.size != size || h.count > UINT32_MAX
+			|| h.count > (size - sizeof h) / sizeof(struct image_symbol)
+			|| h.names != sizeof h + h.count * sizeof(struct image_symbol)) {
+		return -1;
+	}
+	name = base + h.names;
+	for (uint64_t i = 0; i < h.count; ++i) {
+		struct image_symbol s;
+		const char* end = memchr(name, '\0', base + size - name);
+		memcpy(&s, base + sizeof h + i * sizeof s, sizeof s);
+		if (!end || ws_intern(ws, name) != i) { /* Names must be distinct. */
+			return -1;
+		}
+		name = end + 1;
+		if (s.value) {
+			Value v;
+			if (s.value % IMAGE_ALIGN || s.value > size
+					|| s.bytes > size - s.value) {
+				return -1;
+			}
+			v = value_map(base + s.value, s.bytes);
+			if (!v) {
+				return -1;
+			}
+			ws_set(ws, (uint32_t)i, v);
+		}
+	}
+	return 0;
+}
+
+struct Workspace* ws_load(const char* path)
+{
+	struct Workspace* ws;
+	struct stat st;
+	void* map;
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	/* Read only: mapped Values are pinned, so their pages stay clean. */
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	ws = ws_make();
+	ws->image = map;
+	ws->image_len = (size_t)st.st_size;
+	if (read_image(ws, map, (uint64_t)st.st_size)) {
+		ws_free(ws);
+		errno = EINVAL;
+		return NULL;
+	}
+	return ws;
+}
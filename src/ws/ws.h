@@ -0,0 +1,46 @@
+#ifndef WS_H_
+#define WS_H_
+
+#include <assert.h>			/* assert() */
+#include <stdint.h>			/* uint32_t, uint64_t */
+#include <stdio.h>			/* FILE* */
+#include <string.h>			/* strcmp(), memcpy() */
+#include "mem/mem.h"		/* mem_alloc(), mem_dealloc() */
+#include "value/value.h"	/* Value types */
+
+/*
+ * A workspace: interned symbols, and the Value bound to each. Names are
+ * interned once, at parse time, so evaluation looks bindings up by index.
+ *
+ * A workspace saves to a single image file, which loads by mapping it:
+ * Values are stored as self-contained blocks and used in place, so nothing
+ * is read until it's touched, and startup costs the same whatever the size.
+*/
+struct Workspace;
+
+struct Workspace* ws_make(void);
+void ws_free(struct Workspace* ws);
+
+/* The symbol for name, made on first use. */
+uint32_t ws_intern(struct Workspace* ws, const char* name);
+const char* ws_name(struct Workspace* ws, uint32_t sym);
+size_t ws_count(struct Workspace* ws); /* Symbols, numbered from 0. */
+
+/* The Value bound to sym, or NULL. The workspace keeps its reference. */
+Value ws_get(struct Workspace* ws, uint32_t sym);
+/* Binds sym to v, taking over the caller's reference. */
+void ws_set(struct Workspace* ws, uint32_t sym, Value v);
+/* Changes whenever sym is bound, so results read from it can be keyed. */
+uint64_t ws_version(struct Workspace* ws, uint32_t sym);
+
+/*
+ * Writes every symbol and binding to path, replacing it atomically.
+ * Returns nonzero, with errno set, on failure.
+*/
+int ws_save(struct Workspace* ws, const char* path);
+/*
+ * A workspace mapping the image at path, which must stay in place until the
+ * workspace is freed. Returns NULL, with errno set, on failure.
+*/
+struct Workspace* ws_load(const char* path);
+#endif
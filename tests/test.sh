@@ -5,7 +5,7 @@ test_string()
 	STRING="$1"
 	echo "==> Testing $STRING"
 	TOKENS_OUTPUT=$(echo $STRING | ./print_tokens)
-	PARSE_OUTPUT=$(echo $STRING | ./parse)
+	PARSE_OUTPUT=$(echo $STRING | ./parse $3)
 
 	if [ "$PARSE_OUTPUT" = "$2" ]; then
 		echo "Test passed"
@@ -22,3 +22,183 @@ test_string "( 1 + 2 + 3 + 4 )"	"10"
 test_string "2 2 + 2 2" "4 4"
 test_string "1 2 3 + 4 5 6" "5 7 9"
 test_string "1 2 3 4 5 + 1 2 3 4" "Error: mismatched shapes."
+test_string "1 2 3 + 4" "5 6 7"
+test_string "2×3÷4" "1.5"
+test_string "(1+2)⌈⍳ 5" "3 3 3 4 5"
+test_string "-2" "-2"
+test_string "3 -2" "1"
+test_string "1 2 3×-1" "-1 -2 -3"
+test_string "1 + 2 $ 3" "Error: bad character $."
+test_string "1 ⍴ 2" "Error: bad character ⍴."
+test_string "9223372036854775807 + 1" "9223372036854775808"
+test_string "9223372036854775807 1 + 1 1" "9223372036854775808 2"
+test_string "4611686018427387903 + 4611686018427387903" "9223372036854775806"
+test_string "1 2 3 - 10" "-9 -8 -7"
+test_string "1 2 3 ÷ 2" "0.5 1 1.5"
+test_string "3 | - 10" "2"
+test_string "0 ÷ 0" "1"
+test_string "-/ 1 2 3 4" "-2"
+test_string "×/ 1 2 3 4" "24"
+test_string "⌈/ 3 1 4" "4"
+test_string "1 2 3 ⌈.+ 1 2 3" "6"
+test_string "( ⍳ 100 ) -.× ⍳ 100" "-5050"
+test_string "+/ ( ⍳ 100 ) -.× ( ⍳ 100 ) ∘.+ ⍳ 70" "-477750"
+test_string "( 1 + 2 ) + 3 4" "6 7"
+test_string "+/ 1 2 3 + 4" "18"
+test_string "1 2 3 4 5 + 10 + 1 1 1 1 1" "12 13 14 15 16" -j
+test_string "9223372036854775807 1 + 1 1" "9223372036854775808 2" -j
+test_string "10 - 1 2 3 ⌈ 3 2 1" "7 8 7" -j
+test_string "1 2 3 4 5 > 2" "0 0 1 1 1"
+test_string "+/ 1 2 3 4 5 ≥ 2" "4"
+test_string "( 1 2 3 4 5 > 2 ) / 10 20 30 40 50" "30 40 50"
+test_string "~ ( 1 2 3 = 2 ) ∨ 1 0 0" "0 0 1"
+test_string "( x ← 1 2 3 ) + x" "2 4 6"
+test_string "x ← 5" ""
+test_string "( 10 20 30 40 ) [ 4 1 ]" "40 10"
+test_string "( ⍳ 5 ) [ 2 3 ] + 1" "3 4"
+test_string "( 1 2 3 ) [ 4 ]" "Error: index error."
+test_string "⍋ 3 1 2 1" "2 4 3 1"
+test_string "⍒ 3 1 2 1" "1 3 2 4"
+test_string "( x ← 5 3 9 3 ) [ ⍒ x ]" "9 5 3 3"
+test_string "10 20 30 20 ⍳ 20 40 10" "2 5 1"
+test_string "3 4 5 ∊ 1 2 3 4" "1 1 0"
+test_string "∪ 3 1 3 2 1" "3 1 2"
+test_string "∪ ( ⍳ 0 )" ""
+test_string "1 2 3 ∘.+ 10 20" "11 21
+12 22
+13 23"
+test_string "1 2 3 ∘.≤ 2" "1 1 0"
+test_string "+/ 1 2 3 ∘.= 3 2 1" "1 1 1"
+test_string "2 3 × 4 5" "8 15"
+test_string "1 2 3 +.× 4 5 6" "32"
+test_string "( 1 2 ∘.+ 1 2 3 ) +.× 1 2 3 ∘.= 1 2" "2 3
+3 4"
+test_string "( 1 2 ∘.= 1 2 ) ∨.∧ 1 2 ∘.< 1 2 3" "0 1 1
+0 0 1"
+
+check()
+{
+	echo "==> Testing $1"
+	if [ "$3" = "$2" ]; then
+		echo "Test passed"
+	else
+		echo "Test failed. Expected: $2. Got: $3."
+	fi
+}
+
+# Waits up to two seconds for a command to succeed.
+wait_for()
+{
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+		if "$@"; then
+			return 0
+		fi
+		sleep 0.1
+	done
+	return 1
+}
+
+TMP=$(mktemp -d)
+
+# One worker, so a failing request shares it with the other client.
+./server -w 1 "$TMP/sock" 2> /dev/null &
+SERVER=$!
+wait_for test -S "$TMP/sock"
+mkfifo "$TMP/b"
+trap '' PIPE # So a dropped client fails the check, not the script.
+./client "$TMP/sock" < "$TMP/b" > "$TMP/b.out" &
+CLIENT=$!
+exec 3> "$TMP/b"
+echo "1 + 1" >&3
+wait_for grep -q . "$TMP/b.out"
+check "server answers pipelined requests past failures" "3
+.
+Error: mismatched shapes.
+.
+7
+.
+Error: internal error.
+.
+10
+." "$(printf '1 + 2\n1 2 + 1 2 3\n3 + 4\n1 +\n5 + 5\n' | ./client "$TMP/sock")"
+echo "2 + 2" >&3
+exec 3>&-
+wait $CLIENT
+check "server keeps other clients through a failure" "2
+.
+4
+." "$(cat "$TMP/b.out")"
+kill $SERVER
+wait $SERVER
+# Folded stacks: the frames from the root, each with its span, then the cost.
+check "profile folds nodes with their spans" "+ stdin:0-9;literal[3] stdin:0-5 3
++ stdin:0-9;literal[1] stdin:8-9 1
++ stdin:0-9 3" "$(echo "1 2 3 + 4" | ./parse -p elements 2>&1 > /dev/null)"
+# Its blocks allocate on the pool's threads, which must count as the node's.
+PRODUCT="( ( ⍳ 300 ) ∘.+ ⍳ 300 ) +.× ( ⍳ 300 ) ∘.+ ⍳ 300"
+check "profile counts bytes allocated by pool threads" \
+	"$(echo "$PRODUCT" | ./parse -t 1 -p bytes 2>&1 > /dev/null | tail -n 1)" \
+	"$(echo "$PRODUCT" | ./parse -t 4 -p bytes 2>&1 > /dev/null | tail -n 1)"
+
+# Writes the bytes printf makes of $2 into file $1 at offset $3.
+patch()
+{
+	printf "$2" | dd of="$1" bs=1 seek="$3" conv=notrunc 2> /dev/null
+}
+
+printf 'x ← 1 2 3 4\ny ← 1 ÷ 2\nz ← ⍳ 1000\n)save %s\n' "$TMP/ws" | ./parse
+check "image saves and loads" "1.5 2.5 3.5 4.5" \
+	"$(printf ')load %s\nx + y\n' "$TMP/ws" | ./parse)"
+check "image loads with -i" "500500" "$(echo "+/ z" | ./parse -i "$TMP/ws")"
+head -c 100 "$TMP/ws" > "$TMP/short"
+check "truncated image is rejected" "$TMP/short: Invalid argument" \
+	"$(echo "1" | ./parse -i "$TMP/short" 2>&1)"
+# x is the image's only Value, its block at 64 and 104 bytes long. Forge a
+# rank of 2 with the shape (2^63 + 2) 2, whose product wraps to x's 4
+# elements, and make room for the longer shape.
+printf 'x ← 1 2 3 4\n)save %s\n' "$TMP/forged" | ./parse
+patch "$TMP/forged" '\260' 32 # The file's size, 176.
+patch "$TMP/forged" '\160' 48 # The block's size, 112.
+patch "$TMP/forged" '\002' 104 # Rank.
+patch "$TMP/forged" '\002\0\0\0\0\0\0\200\002' 128 # Shape.
+patch "$TMP/forged" '\0\0\0\0\0\0\0\0' 168
+check "image whose shape overflows is rejected" \
+	"$TMP/forged: Invalid argument" \
+	"$(echo "x" | ./parse -i "$TMP/forged" 2>&1)"
+
+# Writes each argument, under 256, as a native long.
+longs()
+{
+	for n in "$@"; do
+		printf "\\$(printf %03o "$n")\0\0\0\0\0\0\0"
+	done
+}
+
+A="1 2 3 4 5 6 7 8 9 10"
+W="10 20 30 40 50 60 70 80 90 100"
+longs $A > "$TMP/a"
+longs $W > "$TMP/w"
+longs 1 2 3 > "$TMP/short"
+# Three elements a chunk, so each input is four chunks, the last short.
+check "stream evaluates elementwise across chunks" \
+	"$(echo "$A + $W × 2" | ./parse)" \
+	"$(./stream -n 3 "⍺ + ⍵ × 2" "$TMP/a" "$TMP/w")"
+check "stream compiles elementwise across chunks" \
+	"$(echo "$A - $W ⌈ 50" | ./parse)" \
+	"$(./stream -j -n 3 "⍺ - ⍵ ⌈ 50" "$TMP/a" "$TMP/w")"
+check "stream reduces across chunks" "$(echo "+/ $A × $W" | ./parse)" \
+	"$(./stream -n 3 "+/ ⍺ × ⍵" "$TMP/a" "$TMP/w")"
+check "stream reduces ⍵ alone" "$(echo "⌈/ $W - 35" | ./parse)" \
+	"$(./stream -n 4 "⌈/ ⍵ - 35" "$TMP/w")"
+check "stream rejects inputs of different lengths" "Error: mismatched shapes." \
+	"$(./stream -n 3 "⍺ + ⍵" "$TMP/a" "$TMP/short")"
+check "stream rejects what isn't elementwise" "Error: only scalar functions \
+of ⍺ and ⍵, and a reduction of them, can be streamed." \
+	"$(./stream -n 3 "⍋ ⍵" "$TMP/w")"
+
+# The second x + 1 must see x rebound, not the first's cached result.
+check "cache misses when a name is rebound" "2 3
+6
+6" "$(printf 'x ← 1 2\nx + 1\nx ← 5\nx + 1\nx + 1\n' | ./parse -c 100000)"
+
+rm -rf "$TMP"